@@ -0,0 +1,119 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+// Microbenchmark of the variants of the entropy probe estimator.  Checks that
+// they give the same estimates, and reports the probing speed of each one
+// over several kinds of data.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run:
+//   ./bench/bench_entropy_probe [nrounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "blosc2.h"
+#include "entropy_probe_match.h"
+
+
+#define BUFFER_SIZE (4 * 1024 * 1024)
+#define BLOCKSIZE (32 * 1024)
+// get_cratio() only looks at the first 8 KB of every block
+#define PROBED_BYTES (8 * 1024)
+
+typedef float (*get_cratio_fn)(const uint8_t *ibase, int maxlen, int minlen, int ipshift);
+
+static const char *kinds[] = {"random", "runs", "sparse", "floats", "repeats"};
+
+static void fill(uint8_t *buffer, int size, int kind) {
+  srand(1);
+  for (int i = 0; i < size; i++) {
+    switch (kind) {
+      case 0:
+        buffer[i] = (uint8_t) rand();
+        break;
+      case 1:
+        buffer[i] = (uint8_t) ((i / 100) % 7);
+        break;
+      case 2:
+        buffer[i] = (i % 4 == 0) ? (uint8_t) (rand() % 4) : 0;
+        break;
+      case 3:
+        if (i % 4 == 0) {
+          float value = (float) (i / 4) * 0.01f;
+          memcpy(buffer + i, &value, (size - i < 4) ? size - i : 4);
+        }
+        break;
+      default:
+        buffer[i] = (i > 0 && rand() % 3 != 0) ? buffer[i - 1] : (uint8_t) rand();
+    }
+  }
+}
+
+// Best time of `nrounds` rounds probing every block of the buffer
+static double bench(get_cratio_fn fn, const uint8_t *buffer, int nrounds) {
+  double best = 1e9;
+  for (int round = 0; round < nrounds; round++) {
+    blosc_timestamp_t t0, t1;
+    volatile float sink = 0;
+    blosc_set_timestamp(&t0);
+    for (int offset = 0; offset + BLOCKSIZE <= BUFFER_SIZE; offset += BLOCKSIZE) {
+      sink += fn(buffer + offset, BLOCKSIZE, 3, 3);
+    }
+    blosc_set_timestamp(&t1);
+    double elapsed = blosc_elapsed_secs(t0, t1);
+    if (elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  int nrounds = (argc > 1) ? atoi(argv[1]) : 50;
+  bool avx2 = entropy_probe_has_avx2();
+  uint8_t *buffer = malloc(BUFFER_SIZE);
+  if (buffer == NULL) {
+    return 1;
+  }
+
+  printf("AVX2 variant: %s\n", avx2 ? "yes" : "not available");
+  printf("%-10s %16s %16s %10s\n", "data", "generic (MB/s)", "avx2 (MB/s)", "speedup");
+  int nmismatches = 0;
+  double probed = (double) (BUFFER_SIZE / BLOCKSIZE) * PROBED_BYTES;
+  for (int kind = 0; kind < (int) (sizeof(kinds) / sizeof(kinds[0])); kind++) {
+    fill(buffer, BUFFER_SIZE, kind);
+    if (avx2) {
+      // Every block size, so that all the tails are exercised
+      for (int size = 16; size <= BLOCKSIZE; size += 61) {
+        if (entropy_probe_get_cratio_generic(buffer, size, 3, 3) !=
+            entropy_probe_get_cratio_avx2(buffer, size, 3, 3)) {
+          nmismatches++;
+        }
+      }
+    }
+    double generic = bench(entropy_probe_get_cratio_generic, buffer, nrounds);
+    if (avx2) {
+      double wide = bench(entropy_probe_get_cratio_avx2, buffer, nrounds);
+      printf("%-10s %16.0f %16.0f %9.2fx\n", kinds[kind], probed / generic / 1e6,
+             probed / wide / 1e6, generic / wide);
+    }
+    else {
+      printf("%-10s %16.0f %16s %10s\n", kinds[kind], probed / generic / 1e6, "-", "-");
+    }
+  }
+  free(buffer);
+
+  if (nmismatches > 0) {
+    printf("ERROR: %d estimates differ between the variants\n", nmismatches);
+    return 1;
+  }
+  return 0;
+}
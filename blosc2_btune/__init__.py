@@ -38,6 +38,38 @@ class PerformanceMode(Enum):
     DECOMP = 1
     BALANCED = 2
     AUTO = 3
+    SLO = 4
+    THROUGHPUT = 5
+
+
+class SamplingMode(Enum):
+    """
+    Available sampling modes for scoring the trial candidates.
+    """
+
+    NONE = 0
+    STRIDED = 1
+    RANDOM = 2
+
+
+class SearchStrategy(Enum):
+    """
+    Available strategies for searching the compression parameters.
+    """
+
+    HILL_CLIMBING = 0
+    UCB = 1
+    THOMPSON = 2
+
+
+class Aggregation(Enum):
+    """
+    Available aggregations for the repeated measurements of a candidate.
+    """
+
+    MEAN = 0
+    MEDIAN = 1
+    TRIMMED_MEAN = 2
 
 
 def get_libpath():
@@ -69,7 +101,30 @@ params_defaults = {
     'nsofts': 5,
     'nhards': 10,
     # behaviour.repeat_mode
-    'repeat_mode': RepeatMode.STOP
+    'repeat_mode': RepeatMode.STOP,
+    'speculative': False,
+    'sampling_mode': SamplingMode.NONE,
+    'sample_nblocks': 8,
+    'search': SearchStrategy.HILL_CLIMBING,
+    'drift_detection': False,
+    'nreps': 1,
+    'aggregation': Aggregation.MEDIAN,
+    'nwarmups': 0,
+    'cache_dir': "",
+    'persist_state': False,
+    'async_dtime': False,
+    'probe_budget': 0,
+    'filter_pruning': False,
+    'codec_pruning': False,
+    'cost_model_topk': 0,
+    'sink_bandwidth': False,
+    'storage_latency': 0.0,
+    'storage_iops': 0,
+    'storage_request_size': 0,
+    'slo_ctime': 0.0,
+    'slo_dtime': 0.0,
+    'min_cspeed': 0,
+    'min_dspeed': 0,
 }
 
 
@@ -85,6 +140,13 @@ def set_params_defaults(**kwargs):
     # Prepare arguments
     params = params_defaults.copy()
     params.update(kwargs)
+    # Get value of enums
+    params['perf_mode'] = params['perf_mode'].value
+    params['repeat_mode'] = params['repeat_mode'].value
+    params['sampling_mode'] = params['sampling_mode'].value
+    params['search'] = params['search'].value
+    params['aggregation'] = params['aggregation'].value
+    params['cache_dir'] = params['cache_dir'].encode('utf-8')
     args = params.values()
     args = list(args)
     # Insert the number of tradeoff values
@@ -96,13 +158,14 @@ def set_params_defaults(**kwargs):
         args[2] = np.array(args[2], dtype=np.float32)
     # args[2] = ctypes.c_float(args[2])
     args[6] = args[6].encode('utf-8')
-    # Get value of enums
-    args[1] = args[1].value
-    args[-1] = args[-1].value
 
     lib.set_params_defaults.argtypes = [ctypes.c_uint] * 2 + [np.ctypeslib.ndpointer(dtype=np.float32)] + \
                                         [ctypes.c_int, ctypes.c_bool, ctypes.c_int, ctypes.c_char_p] +  \
-                                        [ctypes.c_uint] * 4
+                                        [ctypes.c_uint] * 4 + [ctypes.c_bool, ctypes.c_uint, ctypes.c_int, ctypes.c_uint, ctypes.c_bool] + \
+                                        [ctypes.c_int, ctypes.c_uint, ctypes.c_int, ctypes.c_char_p, ctypes.c_bool] + \
+                                        [ctypes.c_bool, ctypes.c_int, ctypes.c_bool, ctypes.c_bool, ctypes.c_int, ctypes.c_bool] + \
+                                        [ctypes.c_float, ctypes.c_uint, ctypes.c_int, ctypes.c_float, ctypes.c_float] + \
+                                        [ctypes.c_uint] * 2
 
     lib.set_params_defaults(*args)
 
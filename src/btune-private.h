@@ -20,9 +20,31 @@
 
 #include <stdbool.h>
 #include "context.h"
-#include "btune.h"
+#include "btune_types.h"
+#include "btune_pool.h"
+#include "btune_bandit.h"
+#include "btune_drift.h"
+#include "btune_job.h"
+#include "btune_latency.h"
+#include "btune_costmodel.h"
+#include "btune_probe.h"
+#include "btune_sink.h"
+#include "entropy_codecs.h"
+#include "entropy_filters.h"
 
 
+// Maximum number of multi-stage pipelines tried on top of a filter
+#define BTUNE_MAX_EXTENSIONS 3
+#define BTUNE_MAX_PIPELINES (BTUNE_MAX_FILTERS * (1 + BTUNE_MAX_EXTENSIONS))
+
+// A pipeline of filters, as in blosc2_cparams
+typedef struct {
+    uint8_t filters[BLOSC2_MAX_FILTERS];
+    // The filters, applied in order
+    uint8_t filters_meta[BLOSC2_MAX_FILTERS];
+    // The meta of every filter
+} btune_pipeline;
+
 // Internal Btune compression parameters
 typedef struct {
     int compcode;
@@ -33,6 +55,8 @@ typedef struct {
     // The precompression filter
     uint8_t filter_meta;
     // The filter meta
+    btune_pipeline pipeline;
+    // The whole filters pipeline (the filter above is its main stage)
     int32_t splitmode;
     // Whether the blocks should be split or not
     int clevel;
@@ -50,15 +74,100 @@ typedef struct {
     bool increasing_nthreads;
     // Control parameter for nthreads
     double score;
-    // The score obtained with this cparams
+    // The score per byte obtained with this cparams
     double cratio;
     // The cratio obtained with this cparams
     double ctime;
-    // The compression time obtained with this cparams
+    // The compression time per byte obtained with this cparams
     double dtime;
-    // The decompression time obtained with this cparams
+    // The decompression time per byte obtained with this cparams
 } cparams_btune;
 
+// Maximum number of cparams kept in the Pareto front
+#define BTUNE_PARETO_SIZE 16
+
+// The non-dominated cparams (in cratio, ctime and dtime) measured so far
+typedef struct {
+    cparams_btune points[BTUNE_PARETO_SIZE];
+    // The cparams in the front, with their measurements
+    int npoints;
+    // Number of cparams in the front
+} btune_pareto;
+
+// Measurements of a compressed chunk, kept until they are used for deciding
+typedef struct {
+    double ctime;
+    // The compression time
+    double dtime;
+    // The decompression time (0 if not measured)
+    size_t cbytes;
+    // The compressed size
+    int32_t nbytes;
+    // The uncompressed size
+    int32_t typesize;
+    // The typesize of the chunk
+    double probe;
+    // The log of the entropy probe cratio (NAN if not computed)
+    bool monitoring;
+    // Whether the chunk is watched for drift
+    int nwarmups;
+    // The warm-up repetitions of the candidate
+    int nreps;
+    // The measured repetitions of the candidate
+} btune_measure;
+
+// The timing of a decompression, which may run in the background
+typedef struct {
+    blosc2_context *dctx;
+    // Context owned by Btune, so that the one of the user is never used concurrently
+    const uint8_t *cdata;
+    // The compressed chunk (the one in the cctx, or cdata_copy)
+    int32_t cbytes;
+    // The compressed size
+    uint8_t *cdata_copy;
+    // Copy of the compressed chunk, for timing in the background
+    int32_t cdata_size;
+    // The allocated size of cdata_copy
+    uint8_t *dest;
+    // Scratch buffer for the decompressed data (the source is never overwritten)
+    int32_t dest_size;
+    // The allocated size of dest
+    int32_t nbytes;
+    // The uncompressed size
+    int32_t blocksize;
+    // The blocksize of the chunk
+    int nthreads;
+    // The number of threads for decompressing
+    int32_t *blocks;
+    // The sampled blocks (sample_nblocks allocated)
+    int nsamples;
+    // Number of sampled blocks (0 for timing the whole chunk)
+    double dtime;
+    // The result
+    int rc;
+    // The result of the decompression (negative on errors, then dtime is not valid)
+} btune_dtime_task;
+
+// Number of chunks submitted in advance with btune_lookahead() that are kept: at most one
+// is being inferred by the helper thread, the rest hold finished results
+#define BTUNE_LOOKAHEAD_DEPTH 2
+
+// A chunk submitted in advance for the entropy probe and the inference
+typedef struct {
+    const void *src;
+    // The chunk (NULL if the entry is free)
+    int32_t size;
+    // The size of the chunk
+    uint64_t fingerprint;
+    // A sample of the contents, so that a buffer reused for new data does not match
+    int32_t blocksize;
+    // The blocksize for the probe
+    int category;
+    // The inferred category (negative on errors)
+    void *btune;
+    // The btune_struct which the entry belongs to
+} btune_lookahead_entry;
+
 // Btune struct
 typedef struct {
   btune_config config;
@@ -71,22 +180,46 @@ typedef struct {
   // The filter list used by Btune
   uint8_t nfilters;
   // Number of filters used by Btune
+  btune_pipeline pipelines[BTUNE_MAX_PIPELINES];
+  // The pipelines explored by the bandit
+  uint8_t pipeline_filters[BTUNE_MAX_PIPELINES];
+  // The main filter of every pipeline explored by the bandit
+  uint8_t npipelines;
+  // Number of pipelines explored by the bandit
+  int32_t typesize;
+  // The typesize of the last chunk
+  bool float_data;
+  // Whether the items are floating point numbers (from the b2nd metalayer)
+  bool float_checked;
+  // Whether float_data has been set
   int32_t splitmode;
   // Splitmode
   uint8_t clevels[BTUNE_MAX_CLEVELS];
   // The clevels list used by Btune
   uint8_t nclevels;
   // Number of clevels used by Btune
+  int32_t blocksizes[BTUNE_MAX_BLOCKSIZES];
+  // The blocksizes list used by Btune
+  uint8_t nblocksizes;
+  // Number of blocksizes used by Btune
+  int blocksize_index;
+  // The index for the blocksizes array
+  int32_t nblocks;
+  // The number of blocks of the last chunk
   cparams_btune * best;
   // The best cparams optained with Btune
   cparams_btune * aux_cparams;
   // The aux cparams for updating the best
   double * current_scores;
-  // The aux array of scores to calculate the mean
+  // The aux array of scores to aggregate the repetitions
   double * current_cratios;
-  // The aux array of cratios to calculate the mean
+  // The aux array of cratios to aggregate the repetitions
+  double * current_ctimes;
+  // The aux array of compression times to aggregate the repetitions
+  double * current_dtimes;
+  // The aux array of decompression times to aggregate the repetitions
   int rep_index;
-  // The aux index for the repetitions
+  // The aux index for the repetitions (warm-ups included)
   int aux_index;
   // The auxiliar index for state management
   int clevel_index;
@@ -125,9 +258,81 @@ typedef struct {
   // Whether all desired ninferences were already performed.
   int models_index;
   // The models index in g_models.
+  btune_pool * pool;
+  // Worker pool for the speculative evaluation of candidates (NULL if not speculative)
+  bool speculated;
+  // Whether the current aux_cparams is the winner of a speculative evaluation
+  uint32_t sample_seed;
+  // The seed for choosing random blocks when sampling
+  btune_bandit * bandit;
+  // The bandit search engine (NULL if not created yet)
+  int bandit_arm;
+  // The arm being evaluated by the bandit (-1 if none)
+  btune_drift drift;
+  // The data drift detector
+  btune_pareto pareto;
+  // The Pareto front of the cparams measured since the last drift
+  uint64_t fingerprint;
+  // The fingerprint of the first chunk (0 if not computed)
+  bool warmstart_pending;
+  // Whether the winner of the next hard readapt has to be cached
+  int saved_steps;
+  // The steps_count when the state was last saved to (or restored from) the super-chunk
+  btune_dtime_task dtime_task;
+  // The timing of the decompression of the last chunk
+  btune_job * job;
+  // Background thread for timing decompressions (NULL if not created yet)
+  btune_measure pending;
+  // The measurements of the last chunk, while its decompression is timed in the background
+  bool has_pending;
+  // Whether a decision is waiting for the pending measurements
+  btune_job * lookahead_job;
+  // Helper thread for the inference of the chunks submitted in advance (NULL if not created yet)
+  btune_lookahead_entry lookahead[BTUNE_LOOKAHEAD_DEPTH];
+  // The chunks submitted in advance
+  int lookahead_next;
+  // The next entry of lookahead to be used
+  btune_probe probe;
+  // The entropy probe contexts and scratch buffers, reused across chunks
+  entropy_filters_features filter_features;
+  // The lane and bit plane entropies of the last chunk probed for pruning the filters
+  btune_costmodel costmodel;
+  // Predictions of the cratio, ctime and dtime of untried cparams
+  int cost_candidates[BTUNE_MAX_CODECS * BTUNE_MAX_FILTERS * 2];
+  // The grid cells tried in the CODEC_FILTER state, when limited by the cost model
+  int ncost_candidates;
+  // Number of cost_candidates (0 for trying the whole grid)
+  double bandwidth;
+  // The bandwidth of the score in KB/s (the one of the config, or the measured one)
+  bool sink_checked;
+  // Whether the storage of the super-chunk has been checked for measuring its bandwidth
+  btune_sink *sink;
+  // The writes of the frame being measured (NULL if none)
+  double traced_bandwidth;
+  // The last measured bandwidth traced
+  int32_t chunksize;
+  // The size of the last chunk compressed
+  btune_latency_hist slo_hist;
+  // The compression times of the chunks compressed with the best cparams (SLO mode)
+  bool slo_watching;
+  // Whether slo_hist holds the times of the current best cparams
+  double slo_tail;
+  // The last p99 of the compression times over the ctime measured for the best cparams
 } btune_struct;
 /// @endcond
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Whether `cparams` restored from outside (a cache or the super-chunk) can be used: a
+// registered codec, and the clevel, threads and blocksize within the limits of Btune
+bool btune_valid_cparams(const btune_struct *btune_params, const cparams_btune *cparams);
+
+#ifdef __cplusplus
+}
+#endif
+
 // Needed for reusing the models
 typedef struct {
     void *comp_interpreter;
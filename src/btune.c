@@ -10,22 +10,33 @@
 **********************************************************************/
 
 #include <stdbool.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
+#include <b2nd.h>
 #include <blosc2/filters-registry.h>
 #include <blosc2/codecs-registry.h>
+#include "btune.h"
 #include "btune_info_public.h"
 #include "btune_model.h"
 #include "entropy_probe.h"
 #include "btune-private.h"
+#include "btune_trial.h"
+#include "btune_cache.h"
+#include "btune_calibrate.h"
+#include "btune_pareto.h"
+#include "btune_warmstart.h"
+#include "btune_persist.h"
 
 
 // Disable different states
 #define BTUNE_ENABLE_MEMCPY       false
 #define BTUNE_ENABLE_THREADS      true
+#define BTUNE_ENABLE_BLOCKSIZE    true
 
 
 // Internal btune control behaviour constants.
@@ -42,6 +53,7 @@ enum {
 static const cparams_btune cparams_btune_default = {
   .compcode = BLOSC_LZ4,
   .filter = BLOSC_SHUFFLE,
+  .pipeline.filters[BLOSC2_MAX_FILTERS - 1] = BLOSC_SHUFFLE,
   .splitmode = BLOSC_ALWAYS_SPLIT,
   .clevel = 9,
   .blocksize = 0,
@@ -56,6 +68,34 @@ static const cparams_btune cparams_btune_default = {
   .dtime = 100
 };
 
+// Tail of the compression times (p99 over the measured ctime) assumed in the SLO mode
+// until it is measured
+#define SLO_DEFAULT_TAIL 1.25
+// Minimum chunks of the best cparams for trusting the p99 of their latencies
+#define SLO_MIN_SAMPLES 16
+// Times over the SLO of a single compression time that backs off without waiting for the p99
+#define SLO_HARD_VIOLATION 2
+// Penalty of the reward in the SLO and THROUGHPUT modes per log of excess over the targets
+#define CONSTRAINT_PENALTY 10
+
+// Whether the perf_mode maximizes the cratio within some targets instead of following
+// the tradeoff
+static bool is_constrained(btune_config *config) {
+  return config->perf_mode == BTUNE_PERF_SLO || config->perf_mode == BTUNE_PERF_THROUGHPUT;
+}
+
+// Whether the decompression times are needed by the perf_mode
+static bool measures_dtime(btune_config *config) {
+  return config->perf_mode == BTUNE_PERF_DECOMP || config->perf_mode == BTUNE_PERF_BALANCED ||
+         (config->perf_mode == BTUNE_PERF_SLO && config->slo_dtime > 0) ||
+         (config->perf_mode == BTUNE_PERF_THROUGHPUT && config->min_dspeed > 0);
+}
+
+// Whether the super-chunk is not stored in files (the same check as btune_sink_attach())
+static bool is_in_memory(blosc2_schunk *schunk) {
+  return schunk->storage == NULL || schunk->storage->urlpath == NULL;
+}
+
 static void add_codec(btune_struct *btune_params, int compcode) {
   for (int i = 0; i < btune_params->ncodecs; i++) {
     if (btune_params->codecs[i] == compcode) {
@@ -78,6 +118,99 @@ static void add_filter(btune_struct *btune_params, uint8_t filter) {
   btune_params->nfilters++;
 }
 
+// Filters estimated worse than the best one by this factor (plus the margin, in
+// bits per byte) are pruned.  Both are loose, as the estimates are rough.
+#define FILTER_PRUNE_RATIO 1.5
+#define FILTER_PRUNE_MARGIN 0.5
+
+// Keep only the filters that may compete with the best one for the chunk being
+// compressed, according to its byte lane and bit plane entropies
+static void prune_filters(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct *) context->tuner_params;
+  entropy_filters_features *features = &btune_params->filter_features;
+  entropy_filters_probe(context->src, context->sourcesize, context->typesize, features);
+
+  const uint8_t filters[] = {BLOSC_NOFILTER, BLOSC_SHUFFLE, BLOSC_BITSHUFFLE};
+  float estimates[3];
+  float best = 8;
+  for (int i = 0; i < 3; i++) {
+    estimates[i] = entropy_filters_estimate(features, filters[i]);
+    if (estimates[i] < best) {
+      best = estimates[i];
+    }
+  }
+  btune_params->nfilters = 0;
+  for (int i = 0; i < 3; i++) {
+    // Shuffle does nothing for 1-byte elements
+    if (filters[i] == BLOSC_SHUFFLE && context->typesize == 1) {
+      continue;
+    }
+    if (estimates[i] <= best * FILTER_PRUNE_RATIO + FILTER_PRUNE_MARGIN) {
+      add_filter(btune_params, filters[i]);
+    }
+  }
+
+  BTUNE_TRACE("Filter entropies: bytes=%.2f runs=%.2f lanes=%.2f lane_runs=%.2f bitplanes=%.2f"
+              " estimates=(%.2f, %.2f, %.2f) filters kept=%d",
+              features->entropy, features->runs, features->lane_entropy, features->lane_runs,
+              features->bitplane_entropy, estimates[0], estimates[1], estimates[2],
+              btune_params->nfilters);
+}
+
+static void btune_init_codecs(btune_struct *btune_params);
+
+// Codecs whose estimated cratio is lower than the best one by this factor are pruned,
+// unless the calibrated speed of the machine for them is higher by the same factor
+#define CODEC_PRUNE_RATIO 1.5
+
+// Keep only the codecs that may compete with the best one for the chunk being
+// compressed, according to the cratios estimated by emulating their parsers
+// and to their speeds in the calibration profile
+static void prune_codecs(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct *) context->tuner_params;
+  float cratios[ENTROPY_NCODECS];
+  if (entropy_codecs_probe(context->src, context->sourcesize, cratios) < 0) {
+    return;
+  }
+
+  // Start from the full list, as a previous hard readapt may have pruned it
+  btune_params->ncodecs = 0;
+  btune_init_codecs(btune_params);
+  int codecs[BTUNE_MAX_CODECS];
+  int ncodecs = btune_params->ncodecs;
+  memcpy(codecs, btune_params->codecs, ncodecs * sizeof(int));
+
+  const btune_calibration *calibration = btune_calibration_get(btune_params->config.cache_dir);
+  float speeds[BTUNE_MAX_CODECS];
+  float best = 0;
+  float best_speed = -1;
+  for (int i = 0; i < ncodecs; i++) {
+    int family = entropy_codecs_family(codecs[i]);
+    speeds[i] = -1;
+    if (calibration != NULL) {
+      speeds[i] = btune_calibration_codec_speed(calibration, codecs[i], context->sourcesize);
+    }
+    if (family >= 0 && cratios[family] > best) {
+      best = cratios[family];
+      best_speed = speeds[i];
+    }
+  }
+  btune_params->ncodecs = 0;
+  for (int i = 0; i < ncodecs; i++) {
+    int family = entropy_codecs_family(codecs[i]);
+    // LZ4 is mandatory outside of HCR mode, and unknown codecs cannot be estimated
+    bool faster = best_speed > 0 && speeds[i] >= best_speed * CODEC_PRUNE_RATIO;
+    if (codecs[i] == BLOSC_LZ4 || family < 0 || cratios[family] * CODEC_PRUNE_RATIO >= best ||
+        faster) {
+      add_codec(btune_params, codecs[i]);
+    }
+  }
+
+  BTUNE_TRACE("Codec estimates: blosclz=%.2f lz4=%.2f zlib=%.2f zstd=%.2f codecs kept=%d",
+              cratios[ENTROPY_CODEC_BLOSCLZ], cratios[ENTROPY_CODEC_LZ4],
+              cratios[ENTROPY_CODEC_ZLIB], cratios[ENTROPY_CODEC_ZSTD], btune_params->ncodecs);
+}
+
 // Get the codecs list for btune
 static void btune_init_codecs(btune_struct *btune_params) {
   const char * all_codecs = blosc2_list_compressors();
@@ -86,7 +219,18 @@ static void btune_init_codecs(btune_struct *btune_params) {
   if (btune_params->config.tradeoff_nelems == 3) {
     tradeoff_1d = btune_params->config.tradeoff[0] + btune_params->config.tradeoff[2] / 2;
   }
-  if (0.666666 <= tradeoff_1d) {
+  if (is_constrained(&btune_params->config)) {
+    // The best cratio may come from any codec fast enough, so try them all
+    add_codec(btune_params, BLOSC_LZ4);
+    add_codec(btune_params, BLOSC_BLOSCLZ);
+    add_codec(btune_params, BLOSC_LZ4HC);
+    if (strstr(all_codecs, "zstd") != NULL) {
+      add_codec(btune_params, BLOSC_ZSTD);
+    }
+    if (strstr(all_codecs, "zlib") != NULL) {
+      add_codec(btune_params, BLOSC_ZLIB);
+    }
+  } else if (0.666666 <= tradeoff_1d) {
     // In HCR mode only try with ZSTD and ZLIB
     if (strstr(all_codecs, "zstd") != NULL) {
       add_codec(btune_params, BLOSC_ZSTD);
@@ -129,10 +273,43 @@ static void btune_init_clevels(btune_struct *btune_params, int min, int max, int
   }
 }
 
+// Get the blocksizes list for btune: powers of two from MIN_BLOCK up to the
+// share of the last level cache of every thread (but at least the L2 size)
+static void btune_init_blocksizes(btune_struct *btune_params, int nthreads) {
+  int32_t max_blocksize = btune_cache_size(3) / (nthreads > 0 ? nthreads : 1);
+  if (max_blocksize < btune_cache_size(2)) {
+    max_blocksize = btune_cache_size(2);
+  }
+  if (max_blocksize > MAX_BLOCK) {
+    max_blocksize = MAX_BLOCK;
+  }
+
+  btune_params->nblocksizes = 0;
+  for (int32_t blocksize = MIN_BLOCK; blocksize <= max_blocksize; blocksize *= 2) {
+    assert(btune_params->nblocksizes < BTUNE_MAX_BLOCKSIZES);
+    btune_params->blocksizes[btune_params->nblocksizes++] = blocksize;
+  }
+  btune_params->blocksize_index = 0;
+}
+
+// Index of the blocksize in the list which is closest to `blocksize`
+static int closest_blocksize_index(btune_struct *btune_params, int32_t blocksize) {
+  int index = 0;
+  for (int i = 1; i < btune_params->nblocksizes; i++) {
+    if (llabs((int64_t) btune_params->blocksizes[i] - blocksize) <
+        llabs((int64_t) btune_params->blocksizes[index] - blocksize)) {
+      index = i;
+    }
+  }
+  return index;
+}
+
 // Extract the cparams_btune inside blosc2_context
 static void extract_btune_cparams(blosc2_context *context, cparams_btune *cparams){
   cparams->compcode = context->compcode;
   cparams->filter = context->filters[BLOSC2_MAX_FILTERS - 1];
+  memcpy(cparams->pipeline.filters, context->filters, BLOSC2_MAX_FILTERS);
+  memcpy(cparams->pipeline.filters_meta, context->filters_meta, BLOSC2_MAX_FILTERS);
   cparams->clevel = context->clevel;
   cparams->splitmode = context->splitmode;
   cparams->blocksize = context->blocksize;
@@ -155,6 +332,15 @@ static bool has_ended_clevel(btune_struct *btune_params) {
     : (clevel_index - step_size) < 0;
 }
 
+// Check if btune can still modify the blocksize or has to change the direction
+static bool has_ended_blocksize(btune_struct *btune_params) {
+  int blocksize_index = btune_params->blocksize_index;
+  int step_size = btune_params->step_size;
+  return (btune_params->best->increasing_block)
+    ? (blocksize_index + step_size) >= btune_params->nblocksizes
+    : (blocksize_index - step_size) < 0;
+}
+
 // Check if btune can still modify the nthreads or has to change the direction
 static bool has_ended_threads(btune_struct *btune_params) {
   cparams_btune * best = btune_params->best;
@@ -164,7 +350,12 @@ static bool has_ended_threads(btune_struct *btune_params) {
   } else {
     nthreads = best->nthreads_decomp;
   }
-  return ((best->increasing_nthreads && (nthreads == btune_params->max_threads)) ||
+  // There is no point in having more threads than blocks
+  int max_threads = btune_params->max_threads;
+  if (btune_params->nblocks > 0 && btune_params->nblocks < max_threads) {
+    max_threads = btune_params->nblocks;
+  }
+  return ((best->increasing_nthreads && (nthreads >= max_threads)) ||
           (!best->increasing_nthreads && (nthreads == MIN_THREADS)));
 }
 
@@ -183,6 +374,8 @@ static void init_hard(btune_struct *btune_params) {
   btune_params->state = CODEC_FILTER;
   btune_params->step_size = HARD_STEP_SIZE;
   btune_params->readapt_from = HARD;
+  // The chunks submitted in advance were inferred for the data before the change
+  btune_model_lookahead_clear(btune_params);
   if (btune_params->config.perf_mode == BTUNE_PERF_DECOMP) {
     btune_params->threads_for_comp = false;
   } else {
@@ -223,7 +416,66 @@ static void init_without_hards(blosc2_context *ctx) {
   btune_params->is_repeating = true;
 }
 
+// Go on after restoring the state stored in the super-chunk
+static void resume_state(btune_struct *btune_params) {
+  BTUNE_TRACE("Resuming the tuning state stored in the super-chunk (%d chunks tuned)",
+              btune_params->steps_count);
+  btune_params->saved_steps = btune_params->steps_count;
+  btune_params->warmstart_pending = false;
+  *btune_params->aux_cparams = *btune_params->best;
+  if (btune_params->state != WAITING && btune_params->state != STOP) {
+    // An interrupted readapt starts again from its beginning
+    btune_params->aux_index = 0;
+    if (btune_params->readapt_from == HARD) {
+      init_hard(btune_params);
+    } else if (btune_params->readapt_from == SOFT) {
+      init_soft(btune_params);
+    } else {
+      btune_params->state = WAITING;
+    }
+  }
+  if (btune_params->config.behaviour.nhards_before_stop == 1) {
+    btune_params->step_size = SOFT_STEP_SIZE;
+  } else {
+    btune_params->step_size = HARD_STEP_SIZE;
+  }
+}
+
+// Init when starting from known cparams (hinted or cached), so without a hard readapt
+static void init_known_cparams(blosc2_context *ctx) {
+  btune_struct *btune_params = (btune_struct*) ctx->tuner_params;
+  if (btune_params->config.behaviour.nhards_before_stop > 0) {
+    if (btune_params->config.behaviour.nsofts_before_hard > 0){
+      init_soft(btune_params);
+    } else if (btune_params->config.behaviour.nwaits_before_readapt > 0) {
+      btune_params->state = WAITING;
+      btune_params->readapt_from = WAIT;
+    } else {
+      init_hard(btune_params);
+    }
+  } else {
+    init_without_hards(ctx);
+  }
+}
+
+static const char* search_to_str(btune_search_strategy search) {
+  switch (search) {
+    case BTUNE_SEARCH_HILL_CLIMBING:
+      return "HILL_CLIMBING";
+    case BTUNE_SEARCH_UCB:
+      return "UCB";
+    case BTUNE_SEARCH_THOMPSON:
+      return "THOMPSON";
+    default:
+      return "UNKNOWN";
+  }
+}
+
 static const char* stcode_to_stname(btune_struct *btune_params) {
+  if (btune_params->bandit_arm >= 0) {
+    // The bandit has no states
+    return search_to_str(btune_params->config.search);
+  }
   switch (btune_params->state) {
     case CODEC_FILTER:
       return "CODEC_FILTER";
@@ -235,6 +487,8 @@ static const char* stcode_to_stname(btune_struct *btune_params) {
       }
     case CLEVEL:
       return "CLEVEL";
+    case BLOCKSIZE:
+      return "BLOCKSIZE";
     case MEMCPY:
       return "MEMCPY";
     case WAITING:
@@ -267,12 +521,29 @@ static const char* perf_mode_to_str(btune_performance_mode perf_mode) {
       return "BALANCED";
     case BTUNE_PERF_COMP:
       return "COMP";
+    case BTUNE_PERF_SLO:
+      return "SLO";
+    case BTUNE_PERF_THROUGHPUT:
+      return "THROUGHPUT";
     default:
       return "UNKNOWN";
   }
 }
 
 
+static const char* sampling_mode_to_str(btune_sampling_mode sampling_mode) {
+  switch (sampling_mode) {
+    case BTUNE_SAMPLE_NONE:
+      return "NONE";
+    case BTUNE_SAMPLE_STRIDED:
+      return "STRIDED";
+    case BTUNE_SAMPLE_RANDOM:
+      return "RANDOM";
+    default:
+      return "UNKNOWN";
+  }
+}
+
 static void bandwidth_to_str(char * str, uint32_t bandwidth) {
   if (bandwidth < BTUNE_MBPS) {
     sprintf(str, "%d KB/s", bandwidth);
@@ -333,6 +604,12 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
       else if (strcmp(perf_mode, "BALANCED") == 0) {
         btune->config.perf_mode = BTUNE_PERF_BALANCED;
       }
+      else if (strcmp(perf_mode, "SLO") == 0) {
+        btune->config.perf_mode = BTUNE_PERF_SLO;
+      }
+      else if (strcmp(perf_mode, "THROUGHPUT") == 0) {
+        btune->config.perf_mode = BTUNE_PERF_THROUGHPUT;
+      }
       else {
         BTUNE_TRACE("Unsupported %s compression mode, default to COMP", perf_mode);
         btune->config.perf_mode = BTUNE_PERF_COMP;
@@ -343,6 +620,201 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
     }
   }
 
+  const char* speculative = getenv("BTUNE_SPECULATIVE");
+  if (speculative != NULL) {
+    int value = 0;
+    sscanf(speculative, "%d", &value);
+    btune->config.speculative = value != 0;
+  }
+
+  const char* sampling_mode = getenv("BTUNE_SAMPLE_MODE");
+  if (sampling_mode != NULL) {
+    if (strcmp(sampling_mode, "NONE") == 0) {
+      btune->config.sampling_mode = BTUNE_SAMPLE_NONE;
+    }
+    else if (strcmp(sampling_mode, "STRIDED") == 0) {
+      btune->config.sampling_mode = BTUNE_SAMPLE_STRIDED;
+    }
+    else if (strcmp(sampling_mode, "RANDOM") == 0) {
+      btune->config.sampling_mode = BTUNE_SAMPLE_RANDOM;
+    }
+    else {
+      BTUNE_TRACE("Unsupported %s sampling mode, default to NONE", sampling_mode);
+      btune->config.sampling_mode = BTUNE_SAMPLE_NONE;
+    }
+  }
+  const char* sample_nblocks = getenv("BTUNE_SAMPLE_NBLOCKS");
+  if (sample_nblocks != NULL) {
+    sscanf(sample_nblocks, "%d", &btune->config.sample_nblocks);
+  }
+  if (btune->config.sample_nblocks <= 0) {
+    btune->config.sampling_mode = BTUNE_SAMPLE_NONE;
+  }
+  btune->sample_seed = 2463534242U;
+
+  const char* search = getenv("BTUNE_SEARCH");
+  if (search != NULL) {
+    if (strcmp(search, "HILL_CLIMBING") == 0) {
+      btune->config.search = BTUNE_SEARCH_HILL_CLIMBING;
+    }
+    else if (strcmp(search, "UCB") == 0) {
+      btune->config.search = BTUNE_SEARCH_UCB;
+    }
+    else if (strcmp(search, "THOMPSON") == 0) {
+      btune->config.search = BTUNE_SEARCH_THOMPSON;
+    }
+    else {
+      BTUNE_TRACE("Unsupported %s search strategy, default to HILL_CLIMBING", search);
+      btune->config.search = BTUNE_SEARCH_HILL_CLIMBING;
+    }
+  }
+  btune->bandit_arm = -1;
+
+  const char* drift = getenv("BTUNE_DRIFT");
+  if (drift != NULL) {
+    int value = 0;
+    sscanf(drift, "%d", &value);
+    btune->config.drift_detection = value != 0;
+  }
+
+  const char* nreps = getenv("BTUNE_NREPS");
+  if (nreps != NULL) {
+    sscanf(nreps, "%d", &btune->config.nreps);
+  }
+  if (btune->config.nreps < 1) {
+    btune->config.nreps = 1;
+  }
+  const char* aggregation = getenv("BTUNE_AGGREGATION");
+  if (aggregation != NULL) {
+    if (strcmp(aggregation, "MEAN") == 0) {
+      btune->config.aggregation = BTUNE_AGG_MEAN;
+    }
+    else if (strcmp(aggregation, "MEDIAN") == 0) {
+      btune->config.aggregation = BTUNE_AGG_MEDIAN;
+    }
+    else if (strcmp(aggregation, "TRIMMED_MEAN") == 0) {
+      btune->config.aggregation = BTUNE_AGG_TRIMMED_MEAN;
+    }
+    else {
+      BTUNE_TRACE("Unsupported %s aggregation, default to MEDIAN", aggregation);
+      btune->config.aggregation = BTUNE_AGG_MEDIAN;
+    }
+  }
+  const char* nwarmups = getenv("BTUNE_NWARMUPS");
+  if (nwarmups != NULL) {
+    sscanf(nwarmups, "%d", &btune->config.nwarmups);
+  }
+  if (btune->config.nwarmups < 0) {
+    btune->config.nwarmups = 0;
+  }
+
+  const char* cache_dir = getenv("BTUNE_CACHE_DIR");
+  if (cache_dir != NULL) {
+    strncpy(btune->config.cache_dir, cache_dir, PATH_MAX - 1);
+    btune->config.cache_dir[PATH_MAX - 1] = '\0';
+  }
+
+  const char* persist = getenv("BTUNE_PERSIST");
+  if (persist != NULL) {
+    int value = 0;
+    sscanf(persist, "%d", &value);
+    btune->config.persist_state = value != 0;
+  }
+
+  const char* async_dtime = getenv("BTUNE_ASYNC_DTIME");
+  if (async_dtime != NULL) {
+    int value = 0;
+    sscanf(async_dtime, "%d", &value);
+    btune->config.async_dtime = value != 0;
+  }
+
+  const char* probe_budget = getenv("BTUNE_PROBE_BUDGET");
+  if (probe_budget != NULL) {
+    sscanf(probe_budget, "%d", &btune->config.probe_budget);
+  }
+  if (btune->config.probe_budget < 0) {
+    btune->config.probe_budget = 0;
+  }
+
+  const char* filter_pruning = getenv("BTUNE_FILTER_PRUNING");
+  if (filter_pruning != NULL) {
+    int value = 0;
+    sscanf(filter_pruning, "%d", &value);
+    btune->config.filter_pruning = value != 0;
+  }
+
+  const char* codec_pruning = getenv("BTUNE_CODEC_PRUNING");
+  if (codec_pruning != NULL) {
+    int value = 0;
+    sscanf(codec_pruning, "%d", &value);
+    btune->config.codec_pruning = value != 0;
+  }
+
+  const char* cost_model_topk = getenv("BTUNE_COST_MODEL_TOPK");
+  if (cost_model_topk != NULL) {
+    sscanf(cost_model_topk, "%d", &btune->config.cost_model_topk);
+  }
+  if (btune->config.cost_model_topk < 0) {
+    btune->config.cost_model_topk = 0;
+  }
+  btune_costmodel_init(&btune->costmodel);
+
+  const char* sink_bandwidth = getenv("BTUNE_SINK_BANDWIDTH");
+  if (sink_bandwidth != NULL) {
+    int value = 0;
+    sscanf(sink_bandwidth, "%d", &value);
+    btune->config.sink_bandwidth = value != 0;
+  }
+  btune->bandwidth = btune->config.bandwidth;
+
+  const char* storage_latency = getenv("BTUNE_STORAGE_LATENCY");
+  if (storage_latency != NULL) {
+    sscanf(storage_latency, "%f", &btune->config.storage_latency);
+  }
+  const char* storage_iops = getenv("BTUNE_STORAGE_IOPS");
+  if (storage_iops != NULL) {
+    sscanf(storage_iops, "%u", &btune->config.storage_iops);
+  }
+  const char* storage_request_size = getenv("BTUNE_STORAGE_REQUEST_SIZE");
+  if (storage_request_size != NULL) {
+    sscanf(storage_request_size, "%d", &btune->config.storage_request_size);
+  }
+  if (btune->config.storage_latency < 0) {
+    btune->config.storage_latency = 0;
+  }
+  if (btune->config.storage_request_size < 0) {
+    btune->config.storage_request_size = 0;
+  }
+
+  const char* slo_ctime = getenv("BTUNE_SLO_CTIME");
+  if (slo_ctime != NULL) {
+    sscanf(slo_ctime, "%f", &btune->config.slo_ctime);
+  }
+  const char* slo_dtime = getenv("BTUNE_SLO_DTIME");
+  if (slo_dtime != NULL) {
+    sscanf(slo_dtime, "%f", &btune->config.slo_dtime);
+  }
+  if (btune->config.perf_mode == BTUNE_PERF_SLO &&
+      btune->config.slo_ctime <= 0 && btune->config.slo_dtime <= 0) {
+    BTUNE_TRACE("The SLO mode needs a slo_ctime or slo_dtime target, default to COMP");
+    btune->config.perf_mode = BTUNE_PERF_COMP;
+  }
+  btune->slo_tail = SLO_DEFAULT_TAIL;
+
+  const char* min_cspeed = getenv("BTUNE_MIN_CSPEED");
+  if (min_cspeed != NULL) {
+    sscanf(min_cspeed, "%u", &btune->config.min_cspeed);
+  }
+  const char* min_dspeed = getenv("BTUNE_MIN_DSPEED");
+  if (min_dspeed != NULL) {
+    sscanf(min_dspeed, "%u", &btune->config.min_dspeed);
+  }
+  if (btune->config.perf_mode == BTUNE_PERF_THROUGHPUT &&
+      btune->config.min_cspeed == 0 && btune->config.min_dspeed == 0) {
+    BTUNE_TRACE("The THROUGHPUT mode needs a min_cspeed or min_dspeed floor, default to COMP");
+    btune->config.perf_mode = BTUNE_PERF_COMP;
+  }
+
   char* envvar = getenv("BTUNE_TRADEOFF");
   if (envvar != NULL) {
     if (strlen(envvar) <= 3) {
@@ -404,9 +876,41 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
            btune->config.behaviour.nsofts_before_hard,
            btune->config.behaviour.nhards_before_stop,
            repeat_mode_to_str(btune->config.behaviour.repeat_mode));
+    if (btune->config.speculative) {
+      printf("Speculative codec/filter evaluation: %d workers\n", cctx->nthreads);
+    }
+    if (btune->config.sampling_mode != BTUNE_SAMPLE_NONE) {
+      printf("Sampling Mode: %s, Sampled blocks: %d\n",
+             sampling_mode_to_str(btune->config.sampling_mode), btune->config.sample_nblocks);
+    }
+    if (btune->config.search != BTUNE_SEARCH_HILL_CLIMBING) {
+      printf("Search Strategy: %s\n", search_to_str(btune->config.search));
+    }
+    if (btune->config.drift_detection) {
+      printf("Drift detection: readapts only on data changes\n");
+    }
+    if (btune->config.perf_mode == BTUNE_PERF_SLO) {
+      printf("SLO: p99 ctime - %g s, p99 dtime - %g s\n",
+             btune->config.slo_ctime, btune->config.slo_dtime);
+    }
+    if (btune->config.perf_mode == BTUNE_PERF_THROUGHPUT) {
+      char cspeed_str[12];
+      char dspeed_str[12];
+      bandwidth_to_str(cspeed_str, btune->config.min_cspeed);
+      bandwidth_to_str(dspeed_str, btune->config.min_dspeed);
+      printf("Throughput floor: compression - %s, decompression - %s\n", cspeed_str, dspeed_str);
+    }
+    if (btune->config.storage_latency > 0 || btune->config.storage_iops > 0) {
+      printf("Storage: latency - %g s, IOPS - %u, Request size - %d\n",
+             btune->config.storage_latency, btune->config.storage_iops,
+             btune->config.storage_request_size);
+    }
   }
 
   btune->dctx = dctx;
+  if (btune->config.speculative) {
+    btune->pool = btune_pool_new(cctx->nthreads);
+  }
 
   // Initialize codecs and filters
   btune_init_codecs(btune);
@@ -415,6 +919,7 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
   add_filter(btune, BLOSC_BITSHUFFLE);
   btune->splitmode = BLOSC_AUTO_SPLIT;
   btune_init_clevels(btune, 1, 9, 9);
+  btune_init_blocksizes(btune, cctx->nthreads);
 
   // State attributes
   btune->rep_index = 0;
@@ -439,7 +944,7 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
   if (btune->config.tradeoff_nelems == 3) {
     tradeoff_1d = btune->config.tradeoff[0] + btune->config.tradeoff[2] / 2;
   }
-  if ((float)2/3 <= tradeoff_1d <= 1.) {
+  if ((float)2/3 <= tradeoff_1d) {
     best->clevel = 8;
     aux->clevel = 8;
   }
@@ -459,9 +964,11 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
   // Provide some room for exploration beyond the theoretical maximum
   btune->max_threads += 8;
 
-  // Aux arrays to calculate the mean
-  btune->current_cratios = malloc(sizeof(double)) ;
-  btune->current_scores = malloc(sizeof(double));
+  // Aux arrays to aggregate the repetitions
+  btune->current_cratios = malloc(btune->config.nreps * sizeof(double));
+  btune->current_scores = malloc(btune->config.nreps * sizeof(double));
+  btune->current_ctimes = malloc(btune->config.nreps * sizeof(double));
+  btune->current_dtimes = malloc(btune->config.nreps * sizeof(double));
 
   if (btune->config.perf_mode == BTUNE_PERF_DECOMP) {
     btune->threads_for_comp = false;
@@ -474,21 +981,11 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
     extract_btune_cparams(cctx, btune->best);
     extract_btune_cparams(cctx, btune->aux_cparams);
     add_codec(btune, cctx->compcode);
-    if (btune->config.behaviour.nhards_before_stop > 0) {
-      if (btune->config.behaviour.nsofts_before_hard > 0){
-        init_soft(btune);
-      } else if (btune->config.behaviour.nwaits_before_readapt > 0) {
-        btune->state = WAITING;
-        btune->readapt_from = WAIT;
-      } else {
-        init_hard(btune);
-      }
-    } else {
-      init_without_hards(cctx);
-    }
+    init_known_cparams(cctx);
   } else {
     init_hard(btune);
     btune->config.behaviour.nhards_before_stop++;
+    btune->warmstart_pending = btune->config.cache_dir[0] != '\0';
   }
   if (btune->config.behaviour.nhards_before_stop == 1) {
     btune->step_size = SOFT_STEP_SIZE;
@@ -499,12 +996,39 @@ int btune_init(void *tuner_params, blosc2_context * cctx, blosc2_context * dctx)
   // Initialize inference data
   btune_model_init(cctx);
 
+  // Resume from the state stored in the super-chunk, if any
+  if (btune->config.persist_state && btune_persist_load(cctx) == 0) {
+    resume_state(btune);
+  }
+
+  // Obtain the calibration profile now if it is going to be needed, so that measuring
+  // it (when not cached) does not delay the compression of the first chunk
+  if (btune->interpreter != NULL || btune->config.codec_pruning ||
+      btune->config.cost_model_topk > 0 ||
+      (btune->config.sink_bandwidth && cctx->schunk != NULL && is_in_memory(cctx->schunk))) {
+    btune_calibration_get(btune->config.cache_dir);
+  }
+
   return BLOSC2_ERROR_SUCCESS;
 }
 
+static void finish_pending(blosc2_context *context);
+
 // Free btune_struct
 int btune_free(blosc2_context *context) {
   btune_struct *btune_params = (btune_struct *) context->tuner_params;
+  finish_pending(context);
+  // The helper thread may be using the models
+  btune_job_free(btune_params->lookahead_job);
+  // Only store the state when something has been tuned since it was last stored.
+  // blosc2_schunk_free() frees the compression context (hence the tuner) before the
+  // frame and the vlmeta layers, so these are still valid here; an in-memory
+  // super-chunk has no frame to keep the state, use btune_checkpoint() for it instead.
+  if (btune_params->config.persist_state && context->schunk != NULL &&
+      context->schunk->frame != NULL &&
+      btune_params->steps_count != btune_params->saved_steps) {
+    btune_persist_save(context);
+  }
   if (btune_params->models_index < 0) {
     btune_model_free(context);
   }
@@ -512,6 +1036,21 @@ int btune_free(blosc2_context *context) {
   free(btune_params->aux_cparams);
   free(btune_params->current_scores);
   free(btune_params->current_cratios);
+  free(btune_params->current_ctimes);
+  free(btune_params->current_dtimes);
+  btune_pool_free(btune_params->pool);
+  btune_bandit_free(btune_params->bandit);
+  btune_job_free(btune_params->job);
+  if (btune_params->sink != NULL) {
+    btune_sink_detach(context->schunk, btune_params->sink);
+  }
+  if (btune_params->dtime_task.dctx != NULL) {
+    blosc2_free_ctx(btune_params->dtime_task.dctx);
+  }
+  free(btune_params->dtime_task.cdata_copy);
+  free(btune_params->dtime_task.dest);
+  free(btune_params->dtime_task.blocks);
+  btune_probe_free(&btune_params->probe);
   btune_params->interpreter = NULL;
   btune_params->metadata = NULL;
   free(btune_params);
@@ -520,38 +1059,140 @@ int btune_free(blosc2_context *context) {
   return BLOSC2_ERROR_SUCCESS;
 }
 
+// Apply the blocksize being tried (or the best one) to the context
+static void set_blocksize(blosc2_context *context, int32_t blocksize) {
+  if (blocksize <= 0) {
+    // Let Blosc2 choose
+    return;
+  }
+  if (blocksize > context->sourcesize) {
+    blocksize = context->sourcesize;
+  }
+  // Blocks must be made of whole items
+  if (blocksize > context->typesize) {
+    blocksize = blocksize / context->typesize * context->typesize;
+  }
+  context->blocksize = blocksize;
+}
+
 // This must exist because unconditionally called by c-blosc2, otherwise there
 // will be a crash
 int btune_next_blocksize(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct *) context->tuner_params;
+  set_blocksize(context, btune_params->aux_cparams->blocksize);
   return BLOSC2_ERROR_SUCCESS;
 }
 
+// The pipeline for a single filter (as chosen by the models)
+static void pipeline_from_filter(btune_pipeline *pipeline, uint8_t filter, uint8_t filter_meta) {
+  memset(pipeline, 0, sizeof(btune_pipeline));
+  uint8_t *filters = pipeline->filters;
+  filters[BLOSC2_MAX_FILTERS - 1] = filter;
+  // Bytedelta requires a shuffle before it
+  if (filter == BLOSC_FILTER_BYTEDELTA) {
+    filters[BLOSC2_MAX_FILTERS - 2] = BLOSC_SHUFFLE;
+  } else if (filter == BLOSC_FILTER_INT_TRUNC) {
+    filters[BLOSC2_MAX_FILTERS - 2] = BLOSC_FILTER_INT_TRUNC;
+    filters[BLOSC2_MAX_FILTERS - 1] = BLOSC_BITSHUFFLE;
+    pipeline->filters_meta[BLOSC2_MAX_FILTERS - 2] = filter_meta;
+  }
+}
+
+// Set a pipeline made of the given filters (up to 2) at the end of the slots
+static void set_pipeline(btune_pipeline *pipeline, uint8_t first, uint8_t first_meta,
+                         uint8_t second, uint8_t second_meta) {
+  memset(pipeline, 0, sizeof(btune_pipeline));
+  pipeline->filters[BLOSC2_MAX_FILTERS - 2] = first;
+  pipeline->filters_meta[BLOSC2_MAX_FILTERS - 2] = first_meta;
+  pipeline->filters[BLOSC2_MAX_FILTERS - 1] = second;
+  pipeline->filters_meta[BLOSC2_MAX_FILTERS - 1] = second_meta;
+}
+
+// Whether the items of the super-chunk of `context` are floating point numbers.  Only
+// known for b2nd arrays, whose dtype is kept in a metalayer.
+static bool has_float_items(blosc2_context *context) {
+  if (context->schunk == NULL) {
+    return false;
+  }
+  uint8_t *smeta;
+  int32_t smeta_len;
+  if (blosc2_meta_get(context->schunk, "b2nd", &smeta, &smeta_len) < 0) {
+    return false;
+  }
+  int8_t ndim;
+  int64_t shape[B2ND_MAX_DIM];
+  int32_t chunkshape[B2ND_MAX_DIM];
+  int32_t blockshape[B2ND_MAX_DIM];
+  char *dtype = NULL;
+  int8_t dtype_format;
+  bool is_float = false;
+  if (b2nd_deserialize_meta(smeta, smeta_len, &ndim, shape, chunkshape, blockshape, &dtype,
+                            &dtype_format) >= 0 && dtype != NULL) {
+    // NumPy dtypes like "<f4" or "<f8"
+    is_float = dtype_format == 0 && strlen(dtype) >= 2 && dtype[1] == 'f';
+  }
+  free(dtype);
+  free(smeta);
+  return is_float;
+}
+
+// Multi-stage pipelines worth trying on top of the `filter` that won among the
+// single filters.  Only the ones that make sense for the typesize are returned,
+// and lossy ones only for floats in quality mode.
+static int pipeline_extensions(btune_struct *btune_params, uint8_t filter, btune_pipeline *pipelines) {
+  int32_t typesize = btune_params->typesize;
+  int n = 0;
+  switch (filter) {
+    case BLOSC_SHUFFLE:
+      // Shuffling single bytes does nothing
+      if (typesize > 1) {
+        set_pipeline(&pipelines[n++], BLOSC_SHUFFLE, 0, BLOSC_FILTER_BYTEDELTA, (uint8_t) typesize);
+        set_pipeline(&pipelines[n++], BLOSC_DELTA, 0, BLOSC_SHUFFLE, 0);
+      }
+      break;
+    case BLOSC_BITSHUFFLE:
+      set_pipeline(&pipelines[n++], BLOSC_DELTA, 0, BLOSC_BITSHUFFLE, 0);
+      // Truncating the mantissa is lossy, so only for floats in quality mode (where
+      // the user accepts losing some precision)
+      if (btune_params->config.tradeoff_nelems == 3 && btune_params->float_data &&
+          (typesize == 4 || typesize == 8)) {
+        // Keep more mantissa bits the more quality is wanted
+        int mantissa_bits = (typesize == 4) ? 23 : 52;
+        float quality = btune_params->config.tradeoff[2];
+        uint8_t nbits = (uint8_t) (mantissa_bits * (0.5f + quality / 2));
+        set_pipeline(&pipelines[n++], BLOSC_TRUNC_PREC, nbits, BLOSC_BITSHUFFLE, 0);
+      }
+      break;
+    default:
+      break;
+  }
+  assert(n <= BTUNE_MAX_EXTENSIONS);
+  return n;
+}
+
+// Fill the filters pipeline for the cparams_btune
+static void fill_filters(cparams_btune *cparams, int32_t typesize, uint8_t *filters, uint8_t *filters_meta) {
+  for (int i = 0; i < BLOSC2_MAX_FILTERS; i++) {
+    filters[i] = cparams->pipeline.filters[i];
+    filters_meta[i] = cparams->pipeline.filters_meta[i];
+    // Bytedelta works on items of typesize bytes
+    if (filters[i] == BLOSC_FILTER_BYTEDELTA && filters_meta[i] == 0) {
+      filters_meta[i] = typesize;
+    }
+  }
+}
+
 // Set the cparams_btune inside blosc2_context
 static void set_btune_cparams(blosc2_context * context, cparams_btune * cparams){
   context->compcode = cparams->compcode;
   context->compcode_meta = cparams->compcode_meta;
-
-  for(int i=0; i < BLOSC2_MAX_FILTERS; i++) {
-      context->filters[i] = 0;
-  }
-  context->filters[BLOSC2_MAX_FILTERS - 1] = cparams->filter;
-  // Bytedelta requires a shuffle before it
-  if (cparams->filter == BLOSC_FILTER_BYTEDELTA) {
-    context->filters[BLOSC2_MAX_FILTERS - 2] = BLOSC_SHUFFLE;
-    context->filters_meta[BLOSC2_MAX_FILTERS - 1] = context->typesize;
-  } else if (cparams->filter == BLOSC_FILTER_INT_TRUNC) {
-    context->filters[BLOSC2_MAX_FILTERS - 2] = BLOSC_FILTER_INT_TRUNC;
-    context->filters[BLOSC2_MAX_FILTERS - 1] = BLOSC_BITSHUFFLE;
-    context->filters_meta[BLOSC2_MAX_FILTERS - 2] = cparams->filter_meta;
-  }
+  fill_filters(cparams, context->typesize, context->filters, context->filters_meta);
 
   context->splitmode = cparams->splitmode;
   context->clevel = cparams->clevel;
   btune_struct *btune_params = (btune_struct*) context->tuner_params;
 
-  if (cparams->blocksize) {
-    context->blocksize = cparams->blocksize;
-  }
+  set_blocksize(context, cparams->blocksize);
   context->new_nthreads = (int16_t) cparams->nthreads_comp;
   if (btune_params->dctx != NULL) {
     btune_params->dctx->new_nthreads = (int16_t) cparams->nthreads_decomp;
@@ -685,6 +1326,73 @@ bool pred_decomp_category(btune_struct *btune_params, int *compcode, uint8_t *co
   return use_model;
 }
 
+// Number of codec, single filter and split combinations explored in the CODEC_FILTER state
+static int codec_filter_grid_size(btune_struct *btune_params) {
+  if (btune_params->ncost_candidates > 0) {
+    return btune_params->ncost_candidates;
+  }
+  int ncandidates = btune_params->ncodecs * btune_params->nfilters;
+  if (btune_params->splitmode == BLOSC_AUTO_SPLIT) {
+    ncandidates *= 2;
+  }
+  return ncandidates;
+}
+
+// Number of candidates of the CODEC_FILTER state: the grid, followed by the
+// multi-stage pipelines that extend the filter of the best candidate (so the
+// pipelines are only tried on top of the best codec, split and filter).
+static int codec_filter_ncandidates(btune_struct *btune_params) {
+  btune_pipeline pipelines[BTUNE_MAX_EXTENSIONS];
+  return codec_filter_grid_size(btune_params) +
+         pipeline_extensions(btune_params, btune_params->best->filter, pipelines);
+}
+
+// Set the codec, filter and split of the `index` candidate of the CODEC_FILTER state
+static void set_codec_filter_candidate(btune_struct *btune_params, cparams_btune *cparams, int index,
+                                       int error, int clevel) {
+  int grid_size = codec_filter_grid_size(btune_params);
+  if (index >= grid_size) {
+    // Extend the filter of the best candidate (cparams starts as a copy of it)
+    btune_pipeline pipelines[BTUNE_MAX_EXTENSIONS];
+    int n = pipeline_extensions(btune_params, cparams->filter, pipelines);
+    if (index - grid_size < n) {
+      cparams->pipeline = pipelines[index - grid_size];
+    }
+    return;
+  }
+
+  // The cells of the grid chosen by the cost model, if any, come in their order
+  if (btune_params->ncost_candidates > 0) {
+    index = btune_params->cost_candidates[index];
+  }
+  int n_filters_splits = btune_params->nfilters * 2;
+  cparams->compcode = btune_params->codecs[index / n_filters_splits];
+  cparams->filter = btune_params->filters[(index % n_filters_splits) / 2];
+  pipeline_from_filter(&cparams->pipeline, cparams->filter, cparams->filter_meta);
+
+  if (btune_params->splitmode == BLOSC_AUTO_SPLIT) {
+    cparams->splitmode = (index % 2) + 1;
+  }
+  else {
+    cparams->splitmode = btune_params->splitmode;
+  }
+
+  btune_performance_mode perf_mode = btune_params->config.perf_mode;
+  if (error == 0) {
+    cparams->clevel = clevel;
+  }
+  else {
+    // The first tuning of ZSTD in some modes should start in clevel 3
+    if (
+      (perf_mode == BTUNE_PERF_COMP || perf_mode == BTUNE_PERF_BALANCED) &&
+      (cparams->compcode == BLOSC_ZSTD || cparams->compcode == BLOSC_ZLIB) &&
+      (btune_params->nhards == 0)
+      ) {
+      cparams->clevel = 3;
+    }
+  }
+}
+
 int tweaking_next_cparams(cparams_btune *cparams, btune_struct *btune_params, bool use_model,
                           int error, int compcode, uint8_t compmeta, uint8_t filter, uint8_t filter_meta, int clevel,
                           int32_t splitmode) {
@@ -697,6 +1405,7 @@ int tweaking_next_cparams(cparams_btune *cparams, btune_struct *btune_params, bo
     cparams->clevel = clevel;
     cparams->compcode = compcode;
     cparams->filter = filter;
+    pipeline_from_filter(&cparams->pipeline, filter, filter_meta);
     cparams->splitmode = splitmode;
     if (btune_params->state == CODEC_FILTER) {
       btune_params->aux_index++;
@@ -708,36 +1417,11 @@ int tweaking_next_cparams(cparams_btune *cparams, btune_struct *btune_params, bo
     }
   }
 
-  btune_config config = btune_params->config;
   switch(btune_params->state){
     // Tune codec and filter
     case CODEC_FILTER: {
       // Cycle codecs, filters and splits
-      int n_filters_splits = btune_params->nfilters * 2;
-      cparams->compcode = btune_params->codecs[btune_params->aux_index / n_filters_splits];
-      cparams->filter = btune_params->filters[(btune_params->aux_index % n_filters_splits) / 2];
-
-      if (btune_params->splitmode == BLOSC_AUTO_SPLIT) {
-        cparams->splitmode = (btune_params->aux_index % 2) + 1;
-      }
-      else {
-        cparams->splitmode = btune_params->splitmode;
-      }
-
-      btune_performance_mode perf_mode = config.perf_mode;
-      if (error == 0) {
-        cparams->clevel = clevel;
-      }
-      else {
-        // The first tuning of ZSTD in some modes should start in clevel 3
-        if (
-          (perf_mode == BTUNE_PERF_COMP || perf_mode == BTUNE_PERF_BALANCED) &&
-          (cparams->compcode == BLOSC_ZSTD || cparams->compcode == BLOSC_ZLIB) &&
-          (btune_params->nhards == 0)
-          ) {
-          cparams->clevel = 3;
-        }
-      }
+      set_codec_filter_candidate(btune_params, cparams, btune_params->aux_index, error, clevel);
 
       if (btune_params->inference_ended) {
         btune_params->aux_index++;
@@ -784,6 +1468,22 @@ int tweaking_next_cparams(cparams_btune *cparams, btune_struct *btune_params, bo
       }
       break;
 
+      // Tune the blocksize
+    case BLOCKSIZE:
+      btune_params->aux_index++;
+
+      if (!has_ended_blocksize(btune_params)) {
+        if (cparams->increasing_block) {
+          btune_params->blocksize_index += btune_params->step_size;
+        }
+        else {
+          btune_params->blocksize_index -= btune_params->step_size;
+        }
+      }
+
+      cparams->blocksize = btune_params->blocksizes[btune_params->blocksize_index];
+      break;
+
       // Try without compressing
     case MEMCPY:
       btune_params->aux_index++;
@@ -803,23 +1503,512 @@ int tweaking_next_cparams(cparams_btune *cparams, btune_struct *btune_params, bo
   return 1; // Continue tuning parameters
 }
 
-// Tune some compression parameters based on the context
-int btune_next_cparams(blosc2_context *context) {
-  btune_struct *btune_params = (btune_struct*) context->tuner_params;
-  btune_config config = btune_params->config;
-  int compcode;
-  uint8_t compmeta = 0;
-  uint8_t filter = BLOSC_NOFILTER;
-  uint8_t filter_meta = 0;
-  int clevel = 5;
-  int32_t splitmode = BLOSC_NEVER_SPLIT;
-  int error = -1;
+static double score_function(btune_struct *btune_params, double ctime, double cbytes,
+                             double dtime);
+static bool has_improved(btune_struct *btune_params, const cparams_btune *candidate,
+                         const cparams_btune *reference);
+
+// The filters of a pipeline joined by dashes (e.g. "1-35" for shuffle and bytedelta)
+static void pipeline_to_str(char *str, size_t size, btune_pipeline *pipeline) {
+  int len = 0;
+  str[0] = '\0';
+  for (int i = 0; i < BLOSC2_MAX_FILTERS; i++) {
+    if (pipeline->filters[i] != BLOSC_NOFILTER) {
+      len += snprintf(str + len, size - len, (len > 0) ? "-%d" : "%d", pipeline->filters[i]);
+    }
+  }
+  if (len == 0) {
+    snprintf(str, size, "%d", BLOSC_NOFILTER);
+  }
+}
 
-  bool use_model;
-  if (config.perf_mode == BTUNE_PERF_DECOMP) {
-    use_model = pred_decomp_category(btune_params, &compcode, &compmeta, &filter, &filter_meta, &clevel, &splitmode);
+// Print a row of the BTUNE_TRACE table
+static void trace_cparams(btune_struct *btune_params, cparams_btune *cparams,
+                          double score, double cratio, char winner) {
+  int split = (cparams->splitmode == BLOSC_ALWAYS_SPLIT) ? 1 : 0;
+  const char *compname;
+  blosc2_compcode_to_compname(cparams->compcode, &compname);
+  char filters_str[4 * BLOSC2_MAX_FILTERS + 1];
+  pipeline_to_str(filters_str, sizeof(filters_str), &cparams->pipeline);
+  // We also use the inverse of the score (per byte) to make it easier to read
+  printf("| %10s | %6s | %5d | %7d | %9d | %9d | %9d | %9.3g | %9.3gx | %15s | %7s | %c\n",
+         compname, filters_str, split, cparams->clevel,
+         (int) cparams->blocksize / BTUNE_KB,
+         cparams->nthreads_comp, cparams->nthreads_decomp,
+         1. / (score * (int)(1<<30)), cratio,
+         stcode_to_stname(btune_params),
+         (btune_params->bandit_arm >= 0) ? "-" : readapt_to_str(btune_params->readapt_from),
+         winner);
+}
+
+// Shared data for the workers of a speculative evaluation
+typedef struct {
+  blosc2_context *context;
+  cparams_btune *candidates;
+  btune_trial *trials;
+  uint8_t **cbuffers;
+  // Per worker buffers for the compressed data
+  uint8_t **dbuffers;
+  // Per worker buffers for the decompressed data (NULL if dtime is not needed)
+  int nthreads;
+  // Threads used by every trial
+  int32_t *blocks;
+  // The sampled blocks (NULL if the whole chunk is used)
+  int nsamples;
+  // The number of sampled blocks
+  int first;
+  // The index of the first candidate of the current round
+} speculation;
+
+static void speculative_trial(void *arg, int index, int worker) {
+  speculation *spec = (speculation *) arg;
+  index += spec->first;
+  blosc2_context *context = spec->context;
+  cparams_btune *candidate = &spec->candidates[index];
+
+  blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
+  cparams.compcode = candidate->compcode;
+  cparams.compcode_meta = candidate->compcode_meta;
+  cparams.clevel = candidate->clevel;
+  cparams.typesize = context->typesize;
+  cparams.blocksize = context->blocksize;
+  cparams.splitmode = candidate->splitmode;
+  cparams.nthreads = (int16_t) spec->nthreads;
+  fill_filters(candidate, context->typesize, cparams.filters, cparams.filters_meta);
+
+  uint8_t *dbuffer = (spec->dbuffers != NULL) ? spec->dbuffers[worker] : NULL;
+  if (spec->blocks != NULL) {
+    btune_trial_run_sampled(&cparams, context->src, context->sourcesize, context->blocksize,
+                            spec->blocks, spec->nsamples, spec->cbuffers[worker], dbuffer,
+                            spec->nthreads, &spec->trials[index]);
   } else {
-    use_model = pred_comp_category(btune_params, &compcode, &compmeta, &filter, &filter_meta, &clevel, &splitmode);
+    btune_trial_run(&cparams, context->src, context->sourcesize, spec->cbuffers[worker],
+                    dbuffer, spec->nthreads, &spec->trials[index]);
+  }
+}
+
+// Compress the current chunk with all the CODEC_FILTER candidates at once and
+// keep the winner as the best cparams.  Returns a negative value if no candidate
+// could be evaluated.
+static int speculate_codec_filter(blosc2_context *context, int error, int clevel) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  bool measure_dtime = measures_dtime(&btune_params->config);
+  int grid_size = codec_filter_grid_size(btune_params);
+  // Room for the grid and for the pipelines extending its winner
+  int ncandidates = grid_size + BTUNE_MAX_EXTENSIONS;
+  int nworkers = btune_pool_nworkers(btune_params->pool);
+  int32_t nbytes = context->sourcesize;
+
+  speculation spec = {0};
+  spec.context = context;
+  spec.nthreads = btune_params->best->nthreads_comp / nworkers;
+  if (spec.nthreads < MIN_THREADS) {
+    spec.nthreads = MIN_THREADS;
+  }
+
+  // Score the candidates on a sample of blocks only (if worth it)
+  int32_t buffer_size = nbytes;
+  int32_t nblocks = 0;
+  if (context->blocksize > 0) {
+    nblocks = nbytes / context->blocksize + ((nbytes % context->blocksize) > 0);
+  }
+  if (btune_params->config.sampling_mode != BTUNE_SAMPLE_NONE &&
+      btune_params->config.sample_nblocks < nblocks) {
+    spec.blocks = malloc(btune_params->config.sample_nblocks * sizeof(int32_t));
+    // Without room for the sample, the whole chunk is scored
+    if (spec.blocks != NULL) {
+      spec.nsamples = btune_sample_blocks(btune_params->config.sampling_mode,
+                                          btune_params->config.sample_nblocks, nblocks,
+                                          &btune_params->sample_seed, spec.blocks);
+      buffer_size = context->blocksize;
+    }
+  }
+
+  spec.candidates = malloc(ncandidates * sizeof(cparams_btune));
+  spec.trials = calloc(ncandidates, sizeof(btune_trial));
+  spec.cbuffers = calloc(nworkers, sizeof(uint8_t *));
+  if (measure_dtime) {
+    spec.dbuffers = calloc(nworkers, sizeof(uint8_t *));
+  }
+  int rc = BLOSC2_ERROR_SUCCESS;
+  if (spec.candidates == NULL || spec.trials == NULL || spec.cbuffers == NULL ||
+      (measure_dtime && spec.dbuffers == NULL)) {
+    free(spec.cbuffers);
+    free(spec.dbuffers);
+    free(spec.blocks);
+    free(spec.trials);
+    free(spec.candidates);
+    return BLOSC2_ERROR_MEMORY_ALLOC;
+  }
+  for (int i = 0; i < nworkers; i++) {
+    spec.cbuffers[i] = malloc(buffer_size + BLOSC2_MAX_OVERHEAD);
+    if (spec.cbuffers[i] == NULL) {
+      rc = BLOSC2_ERROR_MEMORY_ALLOC;
+    }
+    if (measure_dtime) {
+      spec.dbuffers[i] = malloc(buffer_size);
+      if (spec.dbuffers[i] == NULL) {
+        rc = BLOSC2_ERROR_MEMORY_ALLOC;
+      }
+    }
+  }
+
+  // First the grid of single filters, then the pipelines extending the winner
+  cparams_btune winner = *btune_params->best;
+  int nevaluated = 0;
+  int first = 0;
+  int last = grid_size;
+  for (int round = 0; round < 2 && rc == BLOSC2_ERROR_SUCCESS; round++) {
+    if (round == 1) {
+      first = grid_size;
+      btune_pipeline pipelines[BTUNE_MAX_EXTENSIONS];
+      last = grid_size + pipeline_extensions(btune_params, winner.filter, pipelines);
+      if (last == first) {
+        break;
+      }
+    }
+    for (int i = first; i < last; i++) {
+      spec.candidates[i] = (round == 0) ? *btune_params->best : winner;
+      set_codec_filter_candidate(btune_params, &spec.candidates[i], i, error, clevel);
+    }
+    spec.first = first;
+    btune_pool_run(btune_params->pool, speculative_trial, &spec, last - first);
+
+    // Choose the winner as if every candidate had been tried on its own chunk
+    bool trace = getenv("BTUNE_TRACE") != NULL && !btune_params->is_repeating;
+    for (int i = first; i < last; i++) {
+      btune_trial *trial = &spec.trials[i];
+      cparams_btune *candidate = &spec.candidates[i];
+      if (trial->cbytes < 0) {
+        continue;
+      }
+      nevaluated++;
+      candidate->score = score_function(btune_params, trial->ctime, trial->cbytes, trial->dtime) /
+                         trial->nbytes;
+      candidate->cratio = (double) trial->nbytes / (double) trial->cbytes;
+      candidate->ctime = trial->ctime / trial->nbytes;
+      candidate->dtime = trial->dtime / trial->nbytes;
+      bool improved = has_improved(btune_params, candidate, &winner);
+      char winner_mark = '-';
+      if (trial->cbytes <= (BLOSC2_MAX_OVERHEAD + context->typesize)) {
+        improved = false;
+        winner_mark = 'S';
+      }
+      if (improved) {
+        winner = *candidate;
+        winner_mark = 'W';
+      }
+      if (winner_mark != 'S') {
+        btune_pareto_add(&btune_params->pareto, candidate);
+      }
+      if (trace) {
+        if (trial->nsamples > 0) {
+          BTUNE_TRACE("Sampled %d blocks: cratio=[%.3g, %.3g] ctime=%.3g+-%.2g dtime=%.3g+-%.2g",
+                      trial->nsamples,
+                      trial->nbytes / (trial->cbytes + trial->cbytes_ci),
+                      trial->nbytes / fmax(trial->cbytes - trial->cbytes_ci, 1.),
+                      trial->ctime, trial->ctime_ci, trial->dtime, trial->dtime_ci);
+        }
+        trace_cparams(btune_params, candidate, candidate->score,
+                      candidate->cratio, winner_mark);
+      }
+    }
+  }
+  if (rc == BLOSC2_ERROR_SUCCESS) {
+    if (nevaluated == 0) {
+      rc = BLOSC2_ERROR_FAILURE;
+    } else {
+      *btune_params->best = winner;
+      // All the candidates have been tried
+      btune_params->aux_index = codec_filter_ncandidates(btune_params);
+      btune_params->speculated = true;
+    }
+  }
+
+  for (int i = 0; i < nworkers; i++) {
+    if (spec.cbuffers != NULL) {
+      free(spec.cbuffers[i]);
+    }
+    if (spec.dbuffers != NULL) {
+      free(spec.dbuffers[i]);
+    }
+  }
+  free(spec.cbuffers);
+  free(spec.dbuffers);
+  free(spec.blocks);
+  free(spec.trials);
+  free(spec.candidates);
+
+  return rc;
+}
+
+// Add `nthreads` to the list if it is not there yet
+static void add_nthreads(int *nthreads, int *nnthreads, int value) {
+  for (int i = 0; i < *nnthreads; i++) {
+    if (nthreads[i] == value) {
+      return;
+    }
+  }
+  nthreads[(*nnthreads)++] = value;
+}
+
+// Create the bandit with the current codecs, filters, splits and clevels
+static btune_bandit *new_bandit(btune_struct *btune_params) {
+  int32_t splitmodes[2] = {btune_params->splitmode, 0};
+  int nsplitmodes = 1;
+  if (btune_params->splitmode == BLOSC_AUTO_SPLIT) {
+    splitmodes[0] = BLOSC_ALWAYS_SPLIT;
+    splitmodes[1] = BLOSC_NEVER_SPLIT;
+    nsplitmodes = 2;
+  }
+
+  // Half, the same and double the threads in use (within the limits)
+  cparams_btune *best = btune_params->best;
+  int start_nthreads = btune_params->threads_for_comp ? best->nthreads_comp : best->nthreads_decomp;
+  int nthreads[3];
+  int nnthreads = 0;
+  add_nthreads(nthreads, &nnthreads, (start_nthreads / 2 > MIN_THREADS) ? start_nthreads / 2 : MIN_THREADS);
+  add_nthreads(nthreads, &nnthreads, start_nthreads);
+  if (2 * start_nthreads <= btune_params->max_threads) {
+    add_nthreads(nthreads, &nnthreads, 2 * start_nthreads);
+  }
+
+  // Every filter, and the pipelines extending it
+  btune_params->npipelines = 0;
+  for (int i = 0; i < btune_params->nfilters; i++) {
+    uint8_t filter = btune_params->filters[i];
+    int n = btune_params->npipelines;
+    pipeline_from_filter(&btune_params->pipelines[n], filter, 0);
+    n++;
+    n += pipeline_extensions(btune_params, filter, &btune_params->pipelines[n]);
+    for (int j = btune_params->npipelines; j < n; j++) {
+      btune_params->pipeline_filters[j] = filter;
+    }
+    btune_params->npipelines = (uint8_t) n;
+  }
+
+  return btune_bandit_new(btune_params->config.search,
+                          btune_params->codecs, btune_params->ncodecs,
+                          btune_params->npipelines,
+                          splitmodes, nsplitmodes,
+                          btune_params->clevels, btune_params->nclevels,
+                          nthreads, nnthreads, best->clevel, start_nthreads);
+}
+
+// Set the aux_cparams to the next arm chosen by the bandit.  Returns a negative
+// value if the bandit cannot be used.
+static int bandit_next_cparams(btune_struct *btune_params) {
+  if (btune_params->bandit == NULL) {
+    btune_params->bandit = new_bandit(btune_params);
+    if (btune_params->bandit == NULL) {
+      return BLOSC2_ERROR_MEMORY_ALLOC;
+    }
+  }
+  int index = btune_bandit_select(btune_params->bandit);
+  if (index < 0) {
+    return BLOSC2_ERROR_FAILURE;
+  }
+  btune_arm *arm = &btune_params->bandit->arms[index];
+
+  cparams_btune *cparams = btune_params->aux_cparams;
+  *cparams = *btune_params->best;
+  cparams->compcode = arm->compcode;
+  cparams->filter = btune_params->pipeline_filters[arm->filter];
+  cparams->pipeline = btune_params->pipelines[arm->filter];
+  cparams->splitmode = arm->splitmode;
+  cparams->clevel = arm->clevel;
+  if (cparams->clevel == 9 && cparams->compcode == BLOSC_ZSTD) {
+    cparams->clevel = 8;
+  }
+  if (btune_params->threads_for_comp) {
+    cparams->nthreads_comp = arm->nthreads;
+  } else {
+    cparams->nthreads_decomp = arm->nthreads;
+  }
+  btune_params->bandit_arm = index;
+
+  return BLOSC2_ERROR_SUCCESS;
+}
+
+bool btune_valid_cparams(const btune_struct *btune_params, const cparams_btune *cparams) {
+  const char *compname;
+  if (blosc2_compcode_to_compname(cparams->compcode, &compname) < 0) {
+    return false;
+  }
+  if (cparams->clevel < 0 || cparams->clevel > 9) {
+    return false;
+  }
+  if (cparams->nthreads_comp < MIN_THREADS || cparams->nthreads_comp > btune_params->max_threads ||
+      cparams->nthreads_decomp < MIN_THREADS ||
+      cparams->nthreads_decomp > btune_params->max_threads) {
+    return false;
+  }
+  // 0 lets Blosc2 choose the blocksize
+  return cparams->blocksize == 0 ||
+         (cparams->blocksize >= MIN_BLOCK && cparams->blocksize <= MAX_BLOCK);
+}
+
+// Start from the cached cparams (skipping the initial hard readapt) when the
+// first chunk has the fingerprint of a previous stream
+static void warmstart(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  btune_params->fingerprint = btune_fingerprint(context->src, context->sourcesize,
+                                                context->typesize);
+  cparams_btune cached = *btune_params->best;
+  if (btune_warmstart_load(btune_params->config.cache_dir, btune_params->fingerprint,
+                           &btune_params->config, &cached) < 0) {
+    BTUNE_TRACE("No cached cparams for fingerprint %016" PRIx64, btune_params->fingerprint);
+    return;
+  }
+  // The cached threads may come from a different machine
+  if (cached.nthreads_comp < MIN_THREADS || cached.nthreads_comp > btune_params->max_threads) {
+    cached.nthreads_comp = btune_params->best->nthreads_comp;
+  }
+  if (cached.nthreads_decomp < MIN_THREADS || cached.nthreads_decomp > btune_params->max_threads) {
+    cached.nthreads_decomp = btune_params->best->nthreads_decomp;
+  }
+  if (!btune_valid_cparams(btune_params, &cached)) {
+    BTUNE_TRACE("Invalid cached cparams for fingerprint %016" PRIx64, btune_params->fingerprint);
+    return;
+  }
+  BTUNE_TRACE("Starting from the cached cparams for fingerprint %016" PRIx64,
+              btune_params->fingerprint);
+  *btune_params->best = cached;
+  *btune_params->aux_cparams = cached;
+  add_codec(btune_params, cached.compcode);
+  btune_params->warmstart_pending = false;
+  // No inference is needed either
+  btune_params->inference_count = 0;
+  btune_params->inference_ended = true;
+
+  // From now on, behave as if the cached cparams had been hinted
+  btune_params->config.cparams_hint = true;
+  btune_params->config.behaviour.nhards_before_stop--;
+  if (btune_params->config.behaviour.nhards_before_stop == 1) {
+    btune_params->step_size = SOFT_STEP_SIZE;
+  } else {
+    btune_params->step_size = HARD_STEP_SIZE;
+  }
+  init_known_cparams(context);
+}
+
+static double bandit_reward(btune_struct *btune_params, double score, double cratio,
+                           double ctime, double dtime);
+
+static void get_cost_params(const cparams_btune *cparams, btune_cost_params *params) {
+  params->compcode = cparams->compcode;
+  params->filter = cparams->filter;
+  params->splitmode = cparams->splitmode;
+  params->clevel = cparams->clevel;
+  params->blocksize = cparams->blocksize;
+  params->nthreads_comp = cparams->nthreads_comp;
+  params->nthreads_decomp = cparams->nthreads_decomp;
+}
+
+// Limit the codec, filter and split grid of a hard readapt to the `cost_model_topk`
+// cells with the best scores predicted by the cost model, best first (the codecs
+// that it does not model are always tried)
+static void rank_codec_filter_grid(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct *) context->tuner_params;
+  btune_costmodel *model = &btune_params->costmodel;
+  btune_params->ncost_candidates = 0;
+  int grid_size = codec_filter_grid_size(btune_params);
+  int topk = btune_params->config.cost_model_topk;
+  if (grid_size <= topk) {
+    return;
+  }
+  const btune_calibration *calibration = btune_calibration_get(btune_params->config.cache_dir);
+  btune_costmodel_set_chunk(model, context->src, context->sourcesize, context->typesize,
+                            calibration);
+
+  double utilities[BTUNE_MAX_CODECS * BTUNE_MAX_FILTERS * 2];
+  double nbytes = context->sourcesize;
+  int nunknown = 0;
+  for (int i = 0; i < grid_size; i++) {
+    cparams_btune cparams = *btune_params->best;
+    set_codec_filter_candidate(btune_params, &cparams, i, -1, cparams.clevel);
+    btune_cost_params params;
+    get_cost_params(&cparams, &params);
+    btune_cost_prediction prediction;
+    if (btune_costmodel_predict(model, &params, &prediction) < 0) {
+      utilities[i] = INFINITY;
+      nunknown++;
+      continue;
+    }
+    double score = score_function(btune_params, prediction.ctime * nbytes,
+                                  nbytes / prediction.cratio, prediction.dtime * nbytes) / nbytes;
+    utilities[i] = bandit_reward(btune_params, score, prediction.cratio, prediction.ctime,
+                                 prediction.dtime);
+  }
+
+  // The cells that are not modelled are always tried, on top of the topk predicted ones
+  int ncandidates = nunknown + topk;
+  if (ncandidates >= grid_size) {
+    return;
+  }
+  bool chosen[BTUNE_MAX_CODECS * BTUNE_MAX_FILTERS * 2] = {0};
+  for (int n = 0; n < ncandidates; n++) {
+    int best = -1;
+    for (int i = 0; i < grid_size; i++) {
+      if (!chosen[i] && (best < 0 || utilities[i] > utilities[best])) {
+        best = i;
+      }
+    }
+    chosen[best] = true;
+    btune_params->cost_candidates[n] = best;
+  }
+  btune_params->ncost_candidates = ncandidates;
+
+  BTUNE_TRACE("Cost model: trying %d of %d codec/filter candidates (learnt from %d measurements)",
+              ncandidates, grid_size, model->nupdates);
+}
+
+// Teach the cost model the measurements of some cparams
+static void update_cost_model(btune_struct *btune_params, const cparams_btune *cparams) {
+  // Without compression the cparams say nothing about the codec
+  if (btune_params->config.cost_model_topk == 0 || cparams->clevel == 0) {
+    return;
+  }
+  btune_cost_params params;
+  get_cost_params(cparams, &params);
+  btune_costmodel_update(&btune_params->costmodel, &params, cparams->cratio, cparams->ctime,
+                         cparams->dtime);
+}
+
+// Tune some compression parameters based on the context
+int btune_next_cparams(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  finish_pending(context);
+  btune_config config = btune_params->config;
+  int compcode;
+  uint8_t compmeta = 0;
+  uint8_t filter = BLOSC_NOFILTER;
+  uint8_t filter_meta = 0;
+  int clevel = 5;
+  int32_t splitmode = BLOSC_NEVER_SPLIT;
+  int error = -1;
+  btune_params->typesize = context->typesize;
+  if (!btune_params->float_checked) {
+    btune_params->float_data = has_float_items(context);
+    btune_params->float_checked = true;
+  }
+
+  if (btune_params->warmstart_pending && btune_params->steps_count == 0 && context->src != NULL) {
+    warmstart(context);
+  }
+
+  bool use_model;
+  if (config.perf_mode == BTUNE_PERF_DECOMP) {
+    use_model = pred_decomp_category(btune_params, &compcode, &compmeta, &filter, &filter_meta, &clevel, &splitmode);
+  } else {
+    use_model = pred_comp_category(btune_params, &compcode, &compmeta, &filter, &filter_meta, &clevel, &splitmode);
+  }
+
+  if (use_model && is_constrained(&config) && !btune_params->inference_ended) {
+    // The models are trained for the tradeoffs, not for the targets of the constrained
+    // modes, so every codec and filter is explored instead of the predicted category
+    btune_params->inference_count = 0;
+    btune_params->inference_ended = true;
   }
 
   if (use_model) {
@@ -836,6 +2025,10 @@ int btune_next_cparams(blosc2_context *context) {
       }
     }
   }
+  if (!use_model || btune_params->inference_count == 0) {
+    // No chunk submitted in advance is going to be inferred anymore
+    btune_model_lookahead_clear(btune_params);
+  }
 
   if (error == 0) {
     btune_params->codecs[0] = compcode;
@@ -853,13 +2046,61 @@ int btune_next_cparams(blosc2_context *context) {
     btune_params->splitmode = splitmode;
   }
 
+  // Prune the codecs and filters of a hard readapt when no models choose them (without
+  // models, or in the constrained modes, the whole grid is explored, else only the
+  // predicted category)
+  if (use_model && (btune_params->metadata == NULL || is_constrained(&config)) &&
+      btune_params->state == CODEC_FILTER && btune_params->aux_index == 0 && btune_params->rep_index == 0 && context->src != NULL) {
+    if (config.codec_pruning) {
+      prune_codecs(context);
+    }
+    if (config.filter_pruning) {
+      prune_filters(context);
+    }
+    if (config.cost_model_topk > 0) {
+      rank_codec_filter_grid(context);
+    }
+  }
 
   if (getenv("BTUNE_TRACE") && btune_params->steps_count == 0 && btune_params->state != STOP) {
-    // printf("|    Codec   | Filter | Split | C.Level | Blocksize | C.Threads | D.Threads |"
-    printf("|    Codec   | Filter | Split | C.Level | C.Threads | D.Threads |"
+    printf("|    Codec   | Filter | Split | C.Level | Blocksize | C.Threads | D.Threads |"
            "  S.Score  |  C.Ratio   |   Btune State   | Readapt | Winner\n");
   }
 
+  // Keep the same cparams until all the repetitions have been measured
+  if (btune_params->rep_index > 0) {
+    set_btune_cparams(context, btune_params->aux_cparams);
+    if (context->blocksize > context->sourcesize) {
+      context->blocksize = context->sourcesize;
+    }
+    return BLOSC2_ERROR_SUCCESS;
+  }
+
+  // Bandit search over all the combinations of cparams
+  if (config.search != BTUNE_SEARCH_HILL_CLIMBING && use_model && btune_params->inference_ended) {
+    if (bandit_next_cparams(btune_params) == 0) {
+      set_btune_cparams(context, btune_params->aux_cparams);
+      if (context->blocksize > context->sourcesize) {
+        context->blocksize = context->sourcesize;
+      }
+      return BLOSC2_ERROR_SUCCESS;
+    }
+  }
+
+  // Speculative evaluation of the whole codec/filter grid in a single chunk
+  if (btune_params->pool != NULL && use_model && btune_params->inference_ended &&
+      btune_params->state == CODEC_FILTER && btune_params->aux_index == 0 &&
+      context->src != NULL) {
+    if (speculate_codec_filter(context, error, clevel) == 0) {
+      *btune_params->aux_cparams = *btune_params->best;
+      set_btune_cparams(context, btune_params->aux_cparams);
+      if (context->blocksize > context->sourcesize) {
+        context->blocksize = context->sourcesize;
+      }
+      return BLOSC2_ERROR_SUCCESS;
+    }
+  }
+
   *btune_params->aux_cparams = *btune_params->best;
   cparams_btune *cparams = btune_params->aux_cparams;
 
@@ -879,23 +2120,54 @@ int btune_next_cparams(blosc2_context *context) {
   return BLOSC2_ERROR_SUCCESS;
 }
 
+// Time for storing (or transmitting) a compressed chunk: every request pays the
+// latency, and the requests cannot go faster than the IOPS of the storage
+static double storage_time(btune_struct *btune_params, double cbytes) {
+  btune_config *config = &btune_params->config;
+  double time = cbytes / (double) BTUNE_KB / btune_params->bandwidth;
+  if (config->storage_latency <= 0 && config->storage_iops == 0) {
+    return time;
+  }
+  double nrequests = 1;
+  if (config->storage_request_size > 0) {
+    nrequests = ceil(cbytes / config->storage_request_size);
+  }
+  time += nrequests * config->storage_latency;
+  if (config->storage_iops > 0 && nrequests / config->storage_iops > time) {
+    time = nrequests / config->storage_iops;
+  }
+  return time;
+}
+
 // Computes the score depending on the perf_mode
-static double score_function(btune_struct *btune_params, double ctime, size_t cbytes,
+static double score_function(btune_struct *btune_params, double ctime, double cbytes,
                              double dtime) {
-  double reduced_cbytes = (double)cbytes / (double) BTUNE_KB;
+  double transmission = storage_time(btune_params, cbytes);
   switch (btune_params->config.perf_mode) {
     case BTUNE_PERF_COMP:
-      return ctime + reduced_cbytes / btune_params->config.bandwidth;
+      return ctime + transmission;
     case BTUNE_PERF_DECOMP:
-      return reduced_cbytes / btune_params->config.bandwidth + dtime;
+      return transmission + dtime;
     case BTUNE_PERF_BALANCED:
-      return ctime + reduced_cbytes / btune_params->config.bandwidth + dtime;
+      return ctime + transmission + dtime;
+    case BTUNE_PERF_SLO:
+    case BTUNE_PERF_THROUGHPUT:
+      // The cratio is what matters, the score just breaks ties
+      return ctime + transmission + dtime;
     default:
       fprintf(stderr, "WARNING: unknown performance mode\n");
       return -1;
   }
 }
 
+// Score per byte of cparams measured per byte, for chunks of the size being compressed
+// (the latency of the storage is paid per chunk)
+static double score_per_byte(btune_struct *btune_params, double ctime, double cratio,
+                             double dtime) {
+  double nbytes = (btune_params->chunksize > 0) ? btune_params->chunksize : 1;
+  return score_function(btune_params, ctime * nbytes, nbytes / cratio, dtime * nbytes) / nbytes;
+}
+
 static double mean(double const * array, int size) {
   double sum = 0;
   for (int i = 0; i < size; i++) {
@@ -904,28 +2176,108 @@ static double mean(double const * array, int size) {
   return sum / size;
 }
 
-// Determines if btune has improved depending on the tradeoff
-static bool has_improved(btune_struct *btune_params, double score_coef, double cratio_coef) {
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+// Combines the repeated measurements of a candidate (sorts the array in place)
+static double aggregate(btune_struct *btune_params, double *array, int size) {
+  if (size == 1) {
+    return array[0];
+  }
+  qsort(array, size, sizeof(double), compare_doubles);
+  switch (btune_params->config.aggregation) {
+    case BTUNE_AGG_MEDIAN:
+      if (size % 2 == 1) {
+        return array[size / 2];
+      }
+      return (array[size / 2 - 1] + array[size / 2]) / 2;
+    case BTUNE_AGG_TRIMMED_MEAN: {
+      int trim = size / 4;
+      return mean(array + trim, size - 2 * trim);
+    }
+    default:
+      return mean(array, size);
+  }
+}
+
+// Whether the cparams being measured are repeated, which only happens when
+// exploring with the hill climbing
+static bool is_repeated(btune_struct *btune_params) {
+  return btune_params->state != WAITING && btune_params->state != STOP &&
+         btune_params->bandit_arm < 0 && !btune_params->speculated;
+}
+
+// How much cparams measured per byte miss the targets of the SLO and THROUGHPUT modes
+// (above 1 when missing them).  In the SLO mode, the p99 of the latencies is the time
+// measured for a chunk times the tail observed for the best cparams.  In the THROUGHPUT
+// mode, the speeds are the measured ones.
+static double constraint_load(btune_struct *btune_params, double ctime, double dtime) {
+  btune_config *config = &btune_params->config;
+  double ctime_target = 0;
+  double dtime_target = 0;
+  double scale = 1;
+  if (config->perf_mode == BTUNE_PERF_SLO) {
+    ctime_target = config->slo_ctime;
+    dtime_target = config->slo_dtime;
+    double nbytes = (btune_params->chunksize > 0) ? btune_params->chunksize : 1;
+    scale = nbytes * btune_params->slo_tail;
+  } else if (config->perf_mode == BTUNE_PERF_THROUGHPUT) {
+    // The times per byte of the floors (in kB/s)
+    ctime_target = (config->min_cspeed > 0) ? 1. / (config->min_cspeed * (double) BTUNE_KB) : 0;
+    dtime_target = (config->min_dspeed > 0) ? 1. / (config->min_dspeed * (double) BTUNE_KB) : 0;
+  }
+  double load = 0;
+  if (ctime_target > 0) {
+    load = ctime * scale / ctime_target;
+  }
+  // The dtime is not measured for every chunk
+  if (dtime_target > 0 && dtime > 0) {
+    load = fmax(load, dtime * scale / dtime_target);
+  }
+  return load;
+}
+
+// Utilities (in log scale) closer than this are a tie, which is about a 1% change
+// of the cratio or of the speed
+#define UTILITY_TIE_MARGIN 0.01
+
+// Utility of cparams (the larger the better).  It is a mix of the log of the cratio
+// and the log of the speed (bytes per score unit) weighted by the tradeoff, so that
+// the best cparams move smoothly with the tradeoff.
+static double tradeoff_utility(btune_struct *btune_params, double score, double cratio) {
   float tradeoff_1d = btune_params->config.tradeoff[0];
   if (btune_params->config.tradeoff_nelems == 3) {
     tradeoff_1d = btune_params->config.tradeoff[0] + btune_params->config.tradeoff[2] / 2;
   }
-  if (tradeoff_1d <= 1/3) {
-    return (((cratio_coef >= 1) && (score_coef > 1)) ||
-            ((cratio_coef > 0.5) && (score_coef > 2)) ||
-            ((cratio_coef > 0.67) && (score_coef > 1.3)) ||
-            ((cratio_coef > 2) && (score_coef > 0.7)));
-  }
-  if (tradeoff_1d <= 2/3) {
-    return (((cratio_coef >= 1) && (score_coef > 1)) ||
-            ((cratio_coef > 1.1) && (score_coef > 0.8)) ||
-            ((cratio_coef > 1.3) && (score_coef > 0.5)));
+  return tradeoff_1d * log(cratio) - (1 - tradeoff_1d) * log(score);
+}
+
+// Determines if btune has improved depending on the tradeoff.  Ties (within
+// UTILITY_TIE_MARGIN) only improve when the candidate is faster without losing cratio.
+static bool has_improved(btune_struct *btune_params, const cparams_btune *candidate,
+                         const cparams_btune *reference) {
+  double cratio_coef = candidate->cratio / reference->cratio;
+  double score_coef = reference->score / candidate->score;
+  double gain;
+  if (is_constrained(&btune_params->config)) {
+    double load = constraint_load(btune_params, candidate->ctime, candidate->dtime);
+    double reference_load = constraint_load(btune_params, reference->ctime, reference->dtime);
+    if (load > 1 || reference_load > 1) {
+      // Meeting the targets comes first, and violations are backed off right away
+      return load < reference_load;
+    }
+    gain = log(cratio_coef);
+  } else {
+    gain = tradeoff_utility(btune_params, candidate->score, candidate->cratio) -
+           tradeoff_utility(btune_params, reference->score, reference->cratio);
   }
-  if (tradeoff_1d <= 1.) {
-    return ((cratio_coef >= 1) && (score_coef > 1));
+  if (fabs(gain) > UTILITY_TIE_MARGIN) {
+    return gain > 0;
   }
-  fprintf(stderr, "WARNING: unknown tradeoff, it must be between 0. and 1.0\n");
-  return false;
+  return (cratio_coef >= 1) && (score_coef > 1);
 }
 
 
@@ -935,6 +2287,16 @@ static void process_waiting_state(blosc2_context *ctx) {
   btune_behaviour behaviour = btune_params->config.behaviour;
   uint32_t minimum_hards = 0;
 
+  if (btune_params->readapt_from == HARD && btune_params->warmstart_pending) {
+    // Cache the winner of the first hard readapt for the next streams
+    btune_params->warmstart_pending = false;
+    if (btune_params->fingerprint != 0 &&
+        btune_warmstart_save(btune_params->config.cache_dir, btune_params->fingerprint,
+                             &btune_params->config, btune_params->best) == 0) {
+      BTUNE_TRACE("Cached the best cparams for fingerprint %016" PRIx64, btune_params->fingerprint);
+    }
+  }
+
   if (!btune_params->config.cparams_hint) {
     minimum_hards++;
   }
@@ -953,6 +2315,23 @@ static void process_waiting_state(blosc2_context *ctx) {
 //  }
   }
 
+  if (btune_params->config.drift_detection) {
+    // Readapts are only triggered by the drift detector, so just wait
+    if (btune_params->readapt_from == HARD) {
+      btune_params->nhards++;
+    } else if (btune_params->readapt_from == SOFT) {
+      btune_params->nsofts++;
+    }
+    if (btune_params->readapt_from != WAIT) {
+      // New baseline for the new best cparams
+      btune_drift_reset(&btune_params->drift);
+    }
+    btune_params->state = WAITING;
+    btune_params->readapt_from = WAIT;
+    btune_params->is_repeating = true;
+    return;
+  }
+
   switch (btune_params->readapt_from) {
     case HARD:
       btune_params->nhards++;
@@ -1045,6 +2424,37 @@ static void process_waiting_state(blosc2_context *ctx) {
   }
 }
 
+// Start tuning the threads (or the clevel if there is a single thread)
+static void init_threads(btune_struct *btune_params) {
+  cparams_btune *best = btune_params->best;
+  btune_params->state = BTUNE_ENABLE_THREADS ? THREADS : CLEVEL;
+
+  // max_threads must be greater than 1
+  if ((btune_params->state == THREADS) && (btune_params->max_threads == 1)) {
+    btune_params->state = CLEVEL;
+  }
+  // Control direction parameters
+  if (btune_params->state == THREADS) {
+    best->increasing_nthreads = !best->increasing_nthreads;
+  } else if (has_ended_clevel(btune_params)) {
+    best->increasing_clevel = !best->increasing_clevel;
+  }
+}
+
+// Start tuning the blocksize from the one used in the last chunk
+static void init_blocksize(blosc2_context *ctx) {
+  btune_struct *btune_params = (btune_struct *) ctx->tuner_params;
+  cparams_btune *best = btune_params->best;
+  btune_params->state = BLOCKSIZE;
+  if (best->blocksize == 0) {
+    best->blocksize = ctx->blocksize;
+  }
+  btune_params->blocksize_index = closest_blocksize_index(btune_params, best->blocksize);
+  if (has_ended_blocksize(btune_params)) {
+    best->increasing_block = !best->increasing_block;
+  }
+}
+
 // State transition handling
 static void update_aux(blosc2_context * ctx, bool improved) {
   btune_struct *btune_params = (btune_struct *) ctx->tuner_params;
@@ -1053,30 +2463,37 @@ static void update_aux(blosc2_context * ctx, bool improved) {
   switch (btune_params->state) {
     case CODEC_FILTER: {
       // Reached last combination of codec filter
-      int aux_index_max = btune_params->ncodecs *  btune_params->nfilters;
-      if (btune_params->splitmode == BLOSC_AUTO_SPLIT) {
-        aux_index_max *= 2;
-      }
+      int aux_index_max = codec_filter_ncandidates(btune_params);
 
       if (btune_params->aux_index >= aux_index_max) {
         btune_params->aux_index = 0;
+        if (BTUNE_ENABLE_BLOCKSIZE) {
+          init_blocksize(ctx);
+        } else {
+          init_threads(btune_params);
+        }
+      }
+      break;
+    }
 
-        btune_params->state = BTUNE_ENABLE_THREADS ? THREADS : CLEVEL;
-
-        // max_threads must be greater than 1
-        if ((btune_params->state == THREADS) && (btune_params->max_threads == 1)) {
-          btune_params->state = CLEVEL;
-          if (has_ended_clevel(btune_params)) {
-            best->increasing_clevel = !best->increasing_clevel;
-          }
+    case BLOCKSIZE:
+      if (!improved) {
+        // Go on from the best blocksize
+        btune_params->blocksize_index = closest_blocksize_index(btune_params, best->blocksize);
+        if (first_time) {
+          best->increasing_block = !best->increasing_block;
         }
-        // Control direction parameters
-        if (btune_params->state == THREADS) {
-          best->increasing_nthreads = !best->increasing_nthreads;
+      }
+      // Can not change parameter or is not improving
+      if (has_ended_blocksize(btune_params) || (!improved && !first_time)) {
+        btune_params->aux_index = 0;
+        if (btune_params->readapt_from == SOFT) {
+          btune_params->state = BTUNE_ENABLE_MEMCPY ? MEMCPY : WAITING;
+        } else {
+          init_threads(btune_params);
         }
       }
       break;
-    }
 
     case THREADS:
       first_time = (btune_params->aux_index % MAX_STATE_THREADS) == 1;
@@ -1085,8 +2502,10 @@ static void update_aux(blosc2_context * ctx, bool improved) {
       }
       // Can not change parameter or is not improving
       if (has_ended_threads(btune_params) || (!improved && !first_time)) {
-        // If perf_mode BALANCED mark btune_params to change threads for decompression
-        if (btune_params->config.perf_mode == BTUNE_PERF_BALANCED) {
+        // If perf_mode BALANCED (or SLO with a dtime target) mark btune_params to change
+        // threads for decompression
+        if (btune_params->config.perf_mode != BTUNE_PERF_DECOMP &&
+            measures_dtime(&btune_params->config)) {
           if (btune_params->aux_index < MAX_STATE_THREADS) {
             btune_params->threads_for_comp = !btune_params->threads_for_comp;
             btune_params->aux_index = MAX_STATE_THREADS;
@@ -1116,7 +2535,12 @@ static void update_aux(blosc2_context * ctx, bool improved) {
       // Can not change parameter or is not improving
       if (has_ended_clevel(btune_params) || (!improved && !first_time)) {
         btune_params->aux_index = 0;
-        btune_params->state = BTUNE_ENABLE_MEMCPY ? MEMCPY : WAITING;
+        if (BTUNE_ENABLE_BLOCKSIZE && btune_params->readapt_from == SOFT) {
+          // Hard readapts tune the blocksize before the threads
+          init_blocksize(ctx);
+        } else {
+          btune_params->state = BTUNE_ENABLE_MEMCPY ? MEMCPY : WAITING;
+        }
       }
       break;
 
@@ -1133,63 +2557,188 @@ static void update_aux(blosc2_context * ctx, bool improved) {
   }
 }
 
-// Update btune structs with the compression results
-int btune_update(blosc2_context * context, double ctime) {
-  btune_struct *btune_params = (btune_struct*)(context->tuner_params);
-  if (btune_params->state == STOP) {
-    return BLOSC2_ERROR_SUCCESS;
+// Reward of the bandit (the larger the better).  It is the utility of the tradeoff,
+// or in the SLO and THROUGHPUT modes the log of the cratio, penalized when missing
+// the targets.
+static double bandit_reward(btune_struct *btune_params, double score, double cratio,
+                           double ctime, double dtime) {
+  if (is_constrained(&btune_params->config)) {
+    double load = constraint_load(btune_params, ctime, dtime);
+    return log(cratio) - CONSTRAINT_PENALTY * ((load > 1) ? log(load) : 0);
   }
+  return tradeoff_utility(btune_params, score, cratio);
+}
 
-  btune_params->steps_count++;
-  cparams_btune * cparams = btune_params->aux_cparams;
+// Feed the bandit with the results of the arm being evaluated
+static void bandit_update(blosc2_context *context, cparams_btune *cparams, size_t cbytes) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  btune_bandit *bandit = btune_params->bandit;
+  char winner = '-';
+  // Chunks made of special values say nothing about the arm
+  if (cbytes <= (BLOSC2_MAX_OVERHEAD + (size_t)context->typesize)) {
+    winner = 'S';
+  } else {
+    double reward = bandit_reward(btune_params, cparams->score, cparams->cratio, cparams->ctime,
+                                  cparams->dtime);
+    btune_bandit_update(bandit, btune_params->bandit_arm, reward);
+    btune_pareto_add(&btune_params->pareto, cparams);
+    update_cost_model(btune_params, cparams);
+    if (btune_bandit_best(bandit) == btune_params->bandit_arm) {
+      *btune_params->best = *cparams;
+      winner = 'W';
+    }
+  }
 
-  // We come from blosc_compress_context(), so we can populate metrics now
-  size_t cbytes = context->destsize;
-  double dtime = 0;
+  if (getenv("BTUNE_TRACE") != NULL) {
+    trace_cparams(btune_params, cparams, cparams->score, cparams->cratio, winner);
+  }
+  btune_params->bandit_arm = -1;
+}
 
-  // Compute the decompression time if needed
-  btune_behaviour behaviour = btune_params->config.behaviour;
-  blosc_timestamp_t last, current;
-  if (!((btune_params->state == WAITING) &&
-      ((behaviour.nwaits_before_readapt == 0) ||
-      (btune_params->nwaitings % behaviour.nwaits_before_readapt != 0))) &&
-      ((btune_params->config.perf_mode == BTUNE_PERF_DECOMP) ||
-      (btune_params->config.perf_mode == BTUNE_PERF_BALANCED)) &&
-       // When the source is NULL (eval with prefilters), decompression is not working.
-       context->dest != NULL) {
-    blosc2_context * dctx;
-    if (btune_params->dctx == NULL) {
-      blosc2_dparams params = { btune_params->nthreads_decomp, NULL, NULL, NULL};
-      dctx = blosc2_create_dctx(params);
-    } else {
-      dctx = btune_params->dctx;
+// Feed the drift detector with a chunk compressed with the best cparams and
+// start a hard readapt if the data has changed
+static void detect_drift(blosc2_context *context, double score, double cratio, double probe) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  double values[BTUNE_DRIFT_NSTATS];
+  values[BTUNE_DRIFT_CRATIO] = log(cratio);
+  values[BTUNE_DRIFT_SCORE] = log(score);
+  values[BTUNE_DRIFT_PROBE] = probe;
+
+  int stat = btune_drift_update(&btune_params->drift, values);
+  if (stat >= 0) {
+    BTUNE_TRACE("Drift detected in the %s, starting a hard readapt", btune_drift_stat_to_str(stat));
+    btune_drift_reset(&btune_params->drift);
+    btune_pareto_reset(&btune_params->pareto);
+    // The old best cannot be compared with the new data, so start from this chunk
+    *btune_params->best = *btune_params->aux_cparams;
+    btune_params->aux_index = 0;
+    btune_params->is_repeating = false;
+    init_hard(btune_params);
+  }
+}
+
+// Make room for `size` bytes in a scratch buffer
+static int grow_buffer(void **buffer, int32_t *buffer_size, int32_t size) {
+  if (*buffer_size >= size) {
+    return 0;
+  }
+  void *new_buffer = realloc(*buffer, size);
+  if (new_buffer == NULL) {
+    return -1;
+  }
+  *buffer = new_buffer;
+  *buffer_size = size;
+  return 0;
+}
+
+// Prepare the timing of the decompression of the chunk just compressed in `context`.
+// The compressed data is copied when the timing runs in the background.
+static int prepare_dtime_task(blosc2_context *context, bool copy) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  btune_dtime_task *task = &btune_params->dtime_task;
+  task->nthreads = btune_params->aux_cparams->nthreads_decomp;
+  if (task->dctx == NULL) {
+    blosc2_dparams params = {task->nthreads, NULL, NULL, NULL};
+    task->dctx = blosc2_create_dctx(params);
+    if (task->dctx == NULL) {
+      return -1;
+    }
+  }
+  task->dctx->new_nthreads = (int16_t) task->nthreads;
+  if (grow_buffer((void **) &task->dest, &task->dest_size, context->sourcesize) < 0) {
+    return -1;
+  }
+  task->nbytes = context->sourcesize;
+  task->cbytes = context->destsize;
+  task->cdata = context->dest;
+  if (copy) {
+    if (grow_buffer((void **) &task->cdata_copy, &task->cdata_size, task->cbytes) < 0) {
+      return -1;
     }
+    memcpy(task->cdata_copy, context->dest, task->cbytes);
+    task->cdata = task->cdata_copy;
+  }
+
+  task->nsamples = 0;
+  int sample_nblocks = btune_params->config.sample_nblocks;
+  if (btune_params->config.sampling_mode != BTUNE_SAMPLE_NONE &&
+      context->blocksize > 0 && sample_nblocks < context->nblocks) {
+    // Decompress only a sample of the blocks and extrapolate
+    if (task->blocks == NULL) {
+      task->blocks = malloc(sample_nblocks * sizeof(int32_t));
+    }
+    // Without the sample, the whole chunk is decompressed
+    if (task->blocks != NULL) {
+      task->blocksize = context->blocksize;
+      task->nsamples = btune_sample_blocks(btune_params->config.sampling_mode, sample_nblocks,
+                                           context->nblocks, &btune_params->sample_seed,
+                                           task->blocks);
+    }
+  }
+  return 0;
+}
+
+static void run_dtime_task(void *arg) {
+  btune_dtime_task *task = (btune_dtime_task *) arg;
+  task->dtime = 0;
+  task->rc = -1;
+  if (task->nsamples > 0) {
+    double dtime_ci = 0;
+    task->rc = btune_trial_dtime_sampled(task->dctx, task->cdata, task->cbytes, task->dest,
+                                         task->nbytes, task->blocksize, task->nthreads,
+                                         task->blocks, task->nsamples, &task->dtime, &dtime_ci);
+  }
+  if (task->rc < 0) {
+    // Time the whole chunk (also when the sampling failed)
+    blosc_timestamp_t last, current;
     blosc_set_timestamp(&last);
-    blosc2_decompress_ctx(dctx, context->dest, context->destsize, (void*)(context->src),
-                          context->sourcesize);
+    task->rc = blosc2_decompress_ctx(task->dctx, task->cdata, task->cbytes, task->dest,
+                                     task->nbytes);
     blosc_set_timestamp(&current);
-    dtime = blosc_elapsed_secs(last, current);
-    if (btune_params->dctx == NULL) {
-      blosc2_free_ctx(dctx);
-    }
+    task->dtime = blosc_elapsed_secs(last, current);
   }
+}
 
-  double score = score_function(btune_params, ctime, cbytes, dtime);
+// Score the measurements of a chunk and decide the next step of the search
+static void decide(blosc2_context *context, btune_measure *measure) {
+  btune_struct *btune_params = (btune_struct*)(context->tuner_params);
+  cparams_btune * cparams = btune_params->aux_cparams;
+  bool bandit = btune_params->bandit_arm >= 0;
+  size_t cbytes = measure->cbytes;
+  int nwarmups = measure->nwarmups;
+  int nreps = measure->nreps;
+
+  // Normalize by the chunk size, so that chunks of different sizes compare fairly
+  double score = score_function(btune_params, measure->ctime, cbytes, measure->dtime) /
+                 measure->nbytes;
   assert(score > 0);
-  double cratio = (double) context->sourcesize / (double) cbytes;
+  double cratio = (double) measure->nbytes / (double) cbytes;
+  double ctime = measure->ctime / measure->nbytes;
+  double dtime = measure->dtime / measure->nbytes;
 
   cparams->score = score;
   cparams->cratio = cratio;
   cparams->ctime = ctime;
   cparams->dtime = dtime;
-  btune_params->current_scores[btune_params->rep_index] = score;
-  btune_params->current_cratios[btune_params->rep_index] = cratio;
+  if (bandit) {
+    bandit_update(context, cparams, cbytes);
+    return;
+  }
+  int irep = btune_params->rep_index - nwarmups;
+  btune_params->current_scores[irep] = score;
+  btune_params->current_cratios[irep] = cratio;
+  btune_params->current_ctimes[irep] = ctime;
+  btune_params->current_dtimes[irep] = dtime;
   btune_params->rep_index++;
-  if (btune_params->rep_index == 1) {
-    score = mean(btune_params->current_scores, 1);
-    cratio = mean(btune_params->current_cratios, 1);
-    double cratio_coef = cratio / btune_params->best->cratio;
-    double score_coef = btune_params->best->score / score;
+  if (irep + 1 == nreps) {
+    score = aggregate(btune_params, btune_params->current_scores, nreps);
+    cratio = aggregate(btune_params, btune_params->current_cratios, nreps);
+    ctime = aggregate(btune_params, btune_params->current_ctimes, nreps);
+    dtime = aggregate(btune_params, btune_params->current_dtimes, nreps);
+    cparams->score = score;
+    cparams->cratio = cratio;
+    cparams->ctime = ctime;
+    cparams->dtime = dtime;
     bool improved;
     // In state THREADS the improvement comes from ctime or dtime
     if (btune_params->state == THREADS) {
@@ -1199,34 +2748,31 @@ int btune_update(blosc2_context * context, double ctime) {
         improved = dtime < btune_params->best->dtime;
       }
     } else {
-      improved = has_improved(btune_params, score_coef, cratio_coef);
+      improved = has_improved(btune_params, cparams, btune_params->best);
+    }
+    if (btune_params->speculated) {
+      // Commit the speculative winner with the measurements of the production chunk
+      improved = true;
+      btune_params->speculated = false;
     }
     char winner = '-';
     // If the chunk is made of special values, it cannot never improve scoring
-    if (cbytes <= (BLOSC2_MAX_OVERHEAD + (size_t)context->typesize)) {
+    if (cbytes <= (BLOSC2_MAX_OVERHEAD + (size_t)measure->typesize)) {
       improved = false;
       winner = 'S';
     }
     if (improved) {
       winner = 'W';
     }
+    if (winner != 'S') {
+      btune_pareto_add(&btune_params->pareto, cparams);
+      update_cost_model(btune_params, cparams);
+    }
 
     if (!btune_params->is_repeating) {
       char* envvar = getenv("BTUNE_TRACE");
       if (envvar != NULL) {
-        int split = (cparams->splitmode == BLOSC_ALWAYS_SPLIT) ? 1 : 0;
-        const char *compname;
-        blosc2_compcode_to_compname(cparams->compcode, &compname);
-        // Disable printing the Blocksize because it is not currently used
-        //printf("| %10s | %6d | %5d | %7d | %9d | %11d | %9d | %9d | %9.3g | %9.3gx | %15s | %7s | %c\n",
-        // We also use the inverse of the score to make it easier to read
-        printf("| %10s | %6d | %5d | %7d | %9d | %9d | %9.3g | %9.3gx | %15s | %7s | %c\n",
-               compname, cparams->filter, split, cparams->clevel,
-               //(int) cparams->blocksize / BTUNE_KB,
-               cparams->nthreads_comp, cparams->nthreads_decomp,
-               (double) context->sourcesize / (score * (int)(1<<30)), cratio,
-               stcode_to_stname(btune_params),
-               readapt_to_str(btune_params->readapt_from), winner);
+        trace_cparams(btune_params, cparams, score, cratio, winner);
       }
     }
 
@@ -1236,11 +2782,346 @@ int btune_update(blosc2_context * context, double ctime) {
     }
     btune_params->rep_index = 0;
     update_aux(context, improved);
+    if (measure->monitoring && winner != 'S') {
+      detect_drift(context, score, cratio, measure->probe);
+    }
+  }
+}
+
+// Take the decision deferred while the decompression of the last chunk was timed
+static void finish_pending(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct*)(context->tuner_params);
+  if (!btune_params->has_pending) {
+    return;
+  }
+  btune_job_wait(btune_params->job);
+  btune_params->has_pending = false;
+  if (btune_params->dtime_task.rc < 0) {
+    // Without a valid dtime the chunk would score as if it was not decompressed, so the
+    // measurement is discarded and the same cparams are tried again with the next chunk
+    BTUNE_TRACE("Decompression failed while timing the chunk (%d), discarding it",
+                btune_params->dtime_task.rc);
+    return;
+  }
+  btune_params->pending.dtime = btune_params->dtime_task.dtime;
+  decide(context, &btune_params->pending);
+}
+
+// Weight of every new measurement in the moving average of the sink bandwidth
+#define SINK_EWMA_ALPHA 0.2
+
+// Follow the bandwidth of the storage the chunks are written to.  The chunk just
+// compressed is written after this, so the writes measured are the previous ones.
+static void update_sink_bandwidth(blosc2_context *context) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  if (!btune_params->sink_checked) {
+    btune_params->sink_checked = true;
+    btune_params->sink = btune_sink_attach(context->schunk);
+    if (btune_params->sink == NULL && is_in_memory(context->schunk)) {
+      // In-memory super-chunks are bound by the memory bandwidth
+      const btune_calibration *calibration = btune_calibration_get(btune_params->config.cache_dir);
+      if (calibration != NULL) {
+        btune_params->bandwidth =
+          btune_calibration_memcpy_speed(calibration, context->sourcesize) / BTUNE_KB;
+      }
+    }
+  }
+  int64_t nbytes;
+  double secs;
+  if (btune_params->sink == NULL || !btune_sink_take(btune_params->sink, &nbytes, &secs) ||
+      secs <= 0) {
+    return;
+  }
+
+  double bandwidth = (double) nbytes / secs / BTUNE_KB;
+  bool first = btune_params->traced_bandwidth == 0;
+  if (first) {
+    btune_params->bandwidth = bandwidth;
+  }
+  else {
+    btune_params->bandwidth += SINK_EWMA_ALPHA * (bandwidth - btune_params->bandwidth);
+  }
+  // Trace only the significant changes
+  double change = first ? 0 : btune_params->bandwidth / btune_params->traced_bandwidth;
+  if (first || change > 1.25 || change < 0.8) {
+    char bandwidth_str[12];
+    bandwidth_to_str(bandwidth_str, (uint32_t) fmin(btune_params->bandwidth, UINT32_MAX));
+    BTUNE_TRACE("Sink bandwidth: %s", bandwidth_str);
+    btune_params->traced_bandwidth = btune_params->bandwidth;
+  }
+}
+
+static int pareto_select(btune_struct *btune_params);
+
+// Watch the compression times of the chunks compressed with the best cparams in the
+// SLO mode, and back them off as soon as their p99 misses the target (or, before there
+// are samples enough for the p99, as soon as a single one misses it by far): the cparams
+// with the best cratio of the Pareto front that should meet it are used instead, or a
+// hard readapt is started if there are none.  Returns whether the best cparams changed.
+static bool slo_monitor(blosc2_context *context, double ctime) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  btune_latency_hist *hist = &btune_params->slo_hist;
+  if (!btune_params->slo_watching) {
+    // The latencies of the previous best cparams say nothing about the new ones
+    btune_latency_reset(hist);
+    btune_params->slo_watching = true;
+  }
+  btune_latency_add(hist, ctime);
+  cparams_btune *best = btune_params->best;
+  float target = btune_params->config.slo_ctime;
+  double latency = ctime;
+  const char *latency_name = "measured";
+  if (hist->nvalues >= SLO_MIN_SAMPLES) {
+    latency = btune_latency_quantile(hist, 0.99);
+    latency_name = "p99";
+  }
+  else if (target <= 0 || ctime <= SLO_HARD_VIOLATION * target) {
+    // Not enough samples for the p99 yet, and nothing that cannot wait for them
+    return false;
+  }
+  double measured = best->ctime * context->sourcesize;
+  if (measured > 0) {
+    btune_params->slo_tail = fmax(latency / measured, 1.);
+  }
+  if (target <= 0 || latency <= target) {
+    return false;
+  }
+
+  btune_params->slo_watching = false;
+  int selected = pareto_select(btune_params);
+  cparams_btune *point = (selected >= 0) ? &btune_params->pareto.points[selected] : NULL;
+  if (point == NULL || constraint_load(btune_params, point->ctime, point->dtime) > 1) {
+    BTUNE_TRACE("The %s ctime (%.3g s) misses the SLO (%.3g s), starting a hard readapt",
+                latency_name, latency, target);
+    btune_params->aux_index = 0;
+    btune_params->rep_index = 0;
+    btune_params->is_repeating = false;
+    init_hard(btune_params);
+    return true;
+  }
+  *best = *point;
+  best->score = score_per_byte(btune_params, best->ctime, best->cratio, best->dtime);
+  *btune_params->aux_cparams = *best;
+  btune_params->rep_index = 0;
+  set_btune_cparams(context, best);
+  if (getenv("BTUNE_TRACE") != NULL) {
+    BTUNE_TRACE("The %s ctime (%.3g s) misses the SLO (%.3g s), backing off to:",
+                latency_name, latency, target);
+    trace_cparams(btune_params, best, best->score, best->cratio, 'B');
+  }
+  return true;
+}
+
+// Update btune structs with the compression results
+int btune_update(blosc2_context * context, double ctime) {
+  btune_struct *btune_params = (btune_struct*)(context->tuner_params);
+  finish_pending(context);
+  bool bandit = btune_params->bandit_arm >= 0;
+  bool drift_detection = btune_params->config.drift_detection && !bandit;
+  if (btune_params->config.perf_mode == BTUNE_PERF_SLO && !bandit) {
+    if (btune_params->state == WAITING || btune_params->state == STOP) {
+      if (slo_monitor(context, ctime)) {
+        return BLOSC2_ERROR_SUCCESS;
+      }
+    } else {
+      btune_params->slo_watching = false;
+    }
+  }
+  if (btune_params->state == STOP && !bandit && !drift_detection) {
+    return BLOSC2_ERROR_SUCCESS;
+  }
+  // Only the chunks compressed with the best cparams are watched for drift
+  bool monitoring = drift_detection &&
+                    (btune_params->state == WAITING || btune_params->state == STOP);
+
+  btune_params->steps_count++;
+  btune_params->nblocks = context->nblocks;
+  btune_params->chunksize = context->sourcesize;
+  if (btune_params->config.sink_bandwidth && context->schunk != NULL) {
+    update_sink_bandwidth(context);
+  }
+
+  bool repeated = is_repeated(btune_params);
+  int nwarmups = repeated ? btune_params->config.nwarmups : 0;
+  if (btune_params->rep_index < nwarmups) {
+    // Warm-up chunks are not measured
+    btune_params->rep_index++;
+    return BLOSC2_ERROR_SUCCESS;
+  }
+
+  // We come from blosc_compress_context(), so we can populate metrics now
+  btune_measure *measure = &btune_params->pending;
+  measure->ctime = ctime;
+  measure->dtime = 0;
+  measure->cbytes = context->destsize;
+  measure->nbytes = context->sourcesize;
+  measure->typesize = context->typesize;
+  measure->monitoring = monitoring;
+  measure->nwarmups = nwarmups;
+  measure->nreps = repeated ? btune_params->config.nreps : 1;
+  measure->probe = NAN;
+  if (monitoring && context->src != NULL) {
+    measure->probe = log(entropy_probe_cratio(context->src, context->sourcesize));
+  }
+
+  // Compute the decompression time if needed
+  btune_behaviour behaviour = btune_params->config.behaviour;
+  if ((bandit || !((btune_params->state == WAITING) &&
+      ((behaviour.nwaits_before_readapt == 0) || drift_detection ||
+      (btune_params->nwaitings % behaviour.nwaits_before_readapt != 0)))) &&
+      measures_dtime(&btune_params->config) &&
+       // When the source is NULL (eval with prefilters), decompression is not working.
+       context->dest != NULL) {
+    bool async = btune_params->config.async_dtime;
+    if (async && btune_params->job == NULL) {
+      btune_params->job = btune_job_new();
+    }
+    async = async && btune_params->job != NULL;
+    if (prepare_dtime_task(context, async) == 0) {
+      if (async) {
+        // The decision is taken when the next cparams are needed
+        btune_job_submit(btune_params->job, run_dtime_task, &btune_params->dtime_task);
+        btune_params->has_pending = true;
+        return BLOSC2_ERROR_SUCCESS;
+      }
+      run_dtime_task(&btune_params->dtime_task);
+      if (btune_params->dtime_task.rc < 0) {
+        // Discarded, as in finish_pending()
+        BTUNE_TRACE("Decompression failed while timing the chunk (%d), discarding it",
+                    btune_params->dtime_task.rc);
+        return BLOSC2_ERROR_SUCCESS;
+      }
+      measure->dtime = btune_params->dtime_task.dtime;
+    }
   }
 
+  decide(context, measure);
+
+  return BLOSC2_ERROR_SUCCESS;
+}
+
+
+int btune_lookahead(blosc2_context *cctx, const void *src, int32_t srcsize) {
+  btune_struct *btune_params = (btune_struct*) cctx->tuner_params;
+  if (btune_params == NULL || src == NULL) {
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+  if (btune_model_lookahead(cctx, src, srcsize) < 0) {
+    // Nothing to do in advance, the chunk is handled when compressed
+    return 0;
+  }
+  return 1;
+}
+
+int btune_checkpoint(blosc2_context *cctx) {
+  btune_struct *btune_params = (btune_struct*) cctx->tuner_params;
+  if (btune_params == NULL || cctx->schunk == NULL) {
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+  int rc = btune_persist_save(cctx);
+  if (rc < 0) {
+    BTUNE_TRACE("Could not store the tuning state in the super-chunk");
+    return rc;
+  }
+  btune_params->saved_steps = btune_params->steps_count;
   return BLOSC2_ERROR_SUCCESS;
 }
 
+// Choose the point of the Pareto front with the best reward for the current
+// perf_mode and tradeoff (-1 if no point has the needed measurements)
+static int pareto_select(btune_struct *btune_params) {
+  bool needs_dtime = measures_dtime(&btune_params->config);
+  int selected = -1;
+  double best_reward = 0;
+  for (int i = 0; i < btune_params->pareto.npoints; i++) {
+    cparams_btune *point = &btune_params->pareto.points[i];
+    if (needs_dtime && point->dtime <= 0) {
+      continue;
+    }
+    double score = score_per_byte(btune_params, point->ctime, point->cratio, point->dtime);
+    double reward = bandit_reward(btune_params, score, point->cratio, point->ctime, point->dtime);
+    if (selected < 0 || reward > best_reward) {
+      selected = i;
+      best_reward = reward;
+    }
+  }
+  return selected;
+}
+
+int btune_set_performance(blosc2_context *context, uint32_t perf_mode, float *tradeoff,
+                          int tradeoff_nelems) {
+  btune_struct *btune_params = (btune_struct*) context->tuner_params;
+  if (btune_params == NULL) {
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+  if (tradeoff_nelems != 1 && tradeoff_nelems != 3) {
+    BTUNE_TRACE("Unsupported number of tradeoff values, it must be 1 or 3");
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+  float sum = 0.0;
+  for (int i = 0; i < tradeoff_nelems; ++i) {
+    if (tradeoff[i] < 0. || tradeoff[i] > 1.) {
+      BTUNE_TRACE("Unsupported tradeoff, it must be between 0. and 1., ");
+      return BLOSC2_ERROR_INVALID_PARAM;
+    }
+    sum += tradeoff[i];
+  }
+  if (tradeoff_nelems == 3 && (sum != 1.0 || tradeoff[2] == 1.0)) {
+    BTUNE_TRACE("In quality mode, tradeoff values must sum up 1.0 (and quality must be below 1.0)");
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+
+  btune_config *config = &btune_params->config;
+  if (perf_mode == BTUNE_PERF_SLO && config->slo_ctime <= 0 && config->slo_dtime <= 0) {
+    BTUNE_TRACE("The SLO mode needs a slo_ctime or slo_dtime target");
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+  if (perf_mode == BTUNE_PERF_THROUGHPUT && config->min_cspeed == 0 && config->min_dspeed == 0) {
+    BTUNE_TRACE("The THROUGHPUT mode needs a min_cspeed or min_dspeed floor");
+    return BLOSC2_ERROR_INVALID_PARAM;
+  }
+  config->perf_mode = (perf_mode == BTUNE_PERF_AUTO) ? BTUNE_PERF_COMP : perf_mode;
+  config->tradeoff_nelems = tradeoff_nelems;
+  for (int i = 0; i < 3; ++i) {
+    config->tradeoff[i] = (i < tradeoff_nelems) ? tradeoff[i] : 0.0f;
+  }
+  // The codecs worth exploring in future readapts depend on the new config
+  btune_params->ncodecs = 0;
+  btune_init_codecs(btune_params);
+  btune_params->threads_for_comp = (config->perf_mode != BTUNE_PERF_DECOMP);
+  // Past rewards and scores were computed for the old config
+  if (btune_params->bandit != NULL) {
+    btune_bandit_reset(btune_params->bandit);
+  }
+  btune_drift_reset(&btune_params->drift);
+  btune_params->slo_watching = false;
+
+  int selected = pareto_select(btune_params);
+  if (selected < 0) {
+    BTUNE_TRACE("No measured cparams fit the %s mode, starting a hard readapt",
+                perf_mode_to_str(config->perf_mode));
+    btune_params->aux_index = 0;
+    btune_params->rep_index = 0;
+    btune_params->is_repeating = false;
+    init_hard(btune_params);
+    return BLOSC2_ERROR_SUCCESS;
+  }
+
+  cparams_btune *best = btune_params->best;
+  *best = btune_params->pareto.points[selected];
+  best->score = score_per_byte(btune_params, best->ctime, best->cratio, best->dtime);
+  *btune_params->aux_cparams = *best;
+  btune_params->rep_index = 0;
+  // Apply them right away, as no more cparams are set when tuning has stopped
+  set_btune_cparams(context, best);
+  if (getenv("BTUNE_TRACE") != NULL) {
+    BTUNE_TRACE("Selected from the Pareto front (%d points) for the %s mode:",
+                btune_params->pareto.npoints, perf_mode_to_str(config->perf_mode));
+    trace_cparams(btune_params, best, best->score, best->cratio, 'P');
+  }
+
+  return BLOSC2_ERROR_SUCCESS;
+}
 
 int set_params_defaults(
   uint32_t bandwidth,
@@ -1253,7 +3134,30 @@ int set_params_defaults(
   uint32_t nwaits,
   uint32_t nsofts,
   uint32_t nhards,
-  uint32_t repeat_mode
+  uint32_t repeat_mode,
+  bool speculative,
+  uint32_t sampling_mode,
+  int sample_nblocks,
+  uint32_t search,
+  bool drift_detection,
+  int nreps,
+  uint32_t aggregation,
+  int nwarmups,
+  const char* cache_dir,
+  bool persist_state,
+  bool async_dtime,
+  int probe_budget,
+  bool filter_pruning,
+  bool codec_pruning,
+  int cost_model_topk,
+  bool sink_bandwidth,
+  float storage_latency,
+  uint32_t storage_iops,
+  int32_t storage_request_size,
+  float slo_ctime,
+  float slo_dtime,
+  uint32_t min_cspeed,
+  uint32_t min_dspeed
 ) {
   BTUNE_CONFIG_DEFAULTS.bandwidth = bandwidth;
   BTUNE_CONFIG_DEFAULTS.perf_mode = perf_mode;
@@ -1275,6 +3179,30 @@ int set_params_defaults(
   BTUNE_CONFIG_DEFAULTS.behaviour.nsofts_before_hard = nsofts;
   BTUNE_CONFIG_DEFAULTS.behaviour.nhards_before_stop = nhards;
   BTUNE_CONFIG_DEFAULTS.behaviour.repeat_mode = repeat_mode;
+  BTUNE_CONFIG_DEFAULTS.speculative = speculative;
+  BTUNE_CONFIG_DEFAULTS.sampling_mode = sampling_mode;
+  BTUNE_CONFIG_DEFAULTS.sample_nblocks = sample_nblocks;
+  BTUNE_CONFIG_DEFAULTS.search = search;
+  BTUNE_CONFIG_DEFAULTS.drift_detection = drift_detection;
+  BTUNE_CONFIG_DEFAULTS.nreps = nreps;
+  BTUNE_CONFIG_DEFAULTS.aggregation = aggregation;
+  BTUNE_CONFIG_DEFAULTS.nwarmups = nwarmups;
+  strncpy(BTUNE_CONFIG_DEFAULTS.cache_dir, cache_dir, PATH_MAX - 1);
+  BTUNE_CONFIG_DEFAULTS.cache_dir[PATH_MAX - 1] = '\0';
+  BTUNE_CONFIG_DEFAULTS.persist_state = persist_state;
+  BTUNE_CONFIG_DEFAULTS.async_dtime = async_dtime;
+  BTUNE_CONFIG_DEFAULTS.probe_budget = probe_budget;
+  BTUNE_CONFIG_DEFAULTS.filter_pruning = filter_pruning;
+  BTUNE_CONFIG_DEFAULTS.codec_pruning = codec_pruning;
+  BTUNE_CONFIG_DEFAULTS.cost_model_topk = cost_model_topk;
+  BTUNE_CONFIG_DEFAULTS.sink_bandwidth = sink_bandwidth;
+  BTUNE_CONFIG_DEFAULTS.storage_latency = storage_latency;
+  BTUNE_CONFIG_DEFAULTS.storage_iops = storage_iops;
+  BTUNE_CONFIG_DEFAULTS.storage_request_size = storage_request_size;
+  BTUNE_CONFIG_DEFAULTS.slo_ctime = slo_ctime;
+  BTUNE_CONFIG_DEFAULTS.slo_dtime = slo_dtime;
+  BTUNE_CONFIG_DEFAULTS.min_cspeed = min_cspeed;
+  BTUNE_CONFIG_DEFAULTS.min_dspeed = min_dspeed;
 
   return 0;
 }
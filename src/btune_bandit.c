@@ -0,0 +1,223 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "btune_bandit.h"
+
+// Discount applied to the past rewards on every update.  It bounds the
+// effective memory to 1 / (1 - BANDIT_DISCOUNT) chunks.
+#define BANDIT_DISCOUNT 0.99
+// Weight of the UCB exploration bonus
+#define BANDIT_UCB_C 1.0
+// Pseudo-pulls given to the prior (family mean) of an untried arm
+#define BANDIT_PRIOR_PULLS 0.5
+// Minimum standard deviation of the rewards (avoids exploration to vanish)
+#define BANDIT_MIN_SIGMA 0.05
+
+#define BANDIT_PI 3.14159265358979323846
+#define BANDIT_E 2.71828182845904523536
+
+
+// xorshift32 PRNG, uniform in (0, 1)
+static double next_uniform(uint32_t *seed) {
+  uint32_t x = *seed ? *seed : 2463534242U;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return ((double) x + 1.) / 4294967297.;
+}
+
+// Standard normal variate (Box-Muller)
+static double next_gaussian(uint32_t *seed) {
+  double u1 = next_uniform(seed);
+  double u2 = next_uniform(seed);
+  return sqrt(-2 * log(u1)) * cos(2 * BANDIT_PI * u2);
+}
+
+// Pooled standard deviation of the rewards within the arms
+static double pooled_sigma(btune_bandit *bandit) {
+  double ss = 0;
+  double dof = 0;
+  for (int i = 0; i < bandit->narms; i++) {
+    btune_arm *arm = &bandit->arms[i];
+    if (arm->n > 1) {
+      ss += arm->sum2 - arm->sum * arm->sum / arm->n;
+      dof += arm->n - 1;
+    }
+  }
+  double sigma = (dof > 0 && ss > 0) ? sqrt(ss / dof) : 0;
+  return (sigma > BANDIT_MIN_SIGMA) ? sigma : BANDIT_MIN_SIGMA;
+}
+
+
+btune_bandit *btune_bandit_new(btune_search_strategy strategy,
+                               const int *codecs, int ncodecs,
+                               int nfilters,
+                               const int32_t *splitmodes, int nsplitmodes,
+                               const uint8_t *clevels, int nclevels,
+                               const int *nthreads, int nnthreads,
+                               int start_clevel, int start_nthreads) {
+  btune_bandit *bandit = calloc(1, sizeof(btune_bandit));
+  if (bandit == NULL) {
+    return NULL;
+  }
+  bandit->strategy = strategy;
+  bandit->seed = 2463534242U;
+  bandit->nfamilies = ncodecs * nfilters * nsplitmodes;
+  int narms = bandit->nfamilies * nclevels * nnthreads;
+  bandit->arms = calloc(narms, sizeof(btune_arm));
+  if (bandit->arms == NULL) {
+    free(bandit);
+    return NULL;
+  }
+
+  // The representative of a family uses the starting clevel (or the closest one)
+  int start_iclevel = 0;
+  for (int i = 1; i < nclevels; i++) {
+    if (abs(clevels[i] - start_clevel) < abs(clevels[start_iclevel] - start_clevel)) {
+      start_iclevel = i;
+    }
+  }
+  int start_inthreads = 0;
+  for (int i = 1; i < nnthreads; i++) {
+    if (abs(nthreads[i] - start_nthreads) < abs(nthreads[start_inthreads] - start_nthreads)) {
+      start_inthreads = i;
+    }
+  }
+
+  int family = 0;
+  for (int ic = 0; ic < ncodecs; ic++) {
+    for (int ifl = 0; ifl < nfilters; ifl++) {
+      for (int is = 0; is < nsplitmodes; is++) {
+        for (int icl = 0; icl < nclevels; icl++) {
+          for (int it = 0; it < nnthreads; it++) {
+            btune_arm *arm = &bandit->arms[bandit->narms++];
+            arm->compcode = codecs[ic];
+            arm->filter = ifl;
+            arm->splitmode = splitmodes[is];
+            arm->clevel = clevels[icl];
+            arm->nthreads = nthreads[it];
+            arm->family = family;
+            arm->representative = (icl == start_iclevel && it == start_inthreads);
+          }
+        }
+        family++;
+      }
+    }
+  }
+
+  return bandit;
+}
+
+int btune_bandit_select(btune_bandit *bandit) {
+  double *fam_n = calloc(2 * bandit->nfamilies, sizeof(double));
+  if (fam_n == NULL) {
+    return -1;
+  }
+  double *fam_sum = fam_n + bandit->nfamilies;
+  for (int i = 0; i < bandit->narms; i++) {
+    btune_arm *arm = &bandit->arms[i];
+    fam_n[arm->family] += arm->n;
+    fam_sum[arm->family] += arm->sum;
+  }
+
+  // Every family is tried once before comparing them
+  int chosen = -1;
+  for (int i = 0; i < bandit->narms; i++) {
+    btune_arm *arm = &bandit->arms[i];
+    if (arm->representative && fam_n[arm->family] == 0) {
+      chosen = i;
+      break;
+    }
+  }
+
+  if (chosen < 0) {
+    double sigma = pooled_sigma(bandit);
+    double log_t = log(bandit->t > BANDIT_E ? bandit->t : BANDIT_E);
+    double best_index = -DBL_MAX;
+    for (int i = 0; i < bandit->narms; i++) {
+      btune_arm *arm = &bandit->arms[i];
+      double n, mean;
+      if (arm->n > 0) {
+        n = arm->n;
+        mean = arm->sum / arm->n;
+      }
+      else {
+        // Untried arms start from the mean of their family
+        n = BANDIT_PRIOR_PULLS;
+        mean = fam_sum[arm->family] / fam_n[arm->family];
+      }
+      double index;
+      if (bandit->strategy == BTUNE_SEARCH_THOMPSON) {
+        index = mean + sigma / sqrt(n) * next_gaussian(&bandit->seed);
+      }
+      else {
+        index = mean + BANDIT_UCB_C * sigma * sqrt(2 * log_t / n);
+      }
+      if (index > best_index) {
+        best_index = index;
+        chosen = i;
+      }
+    }
+  }
+
+  free(fam_n);
+  return chosen;
+}
+
+void btune_bandit_update(btune_bandit *bandit, int arm, double reward) {
+  if (arm < 0 || arm >= bandit->narms || !isfinite(reward)) {
+    return;
+  }
+  for (int i = 0; i < bandit->narms; i++) {
+    bandit->arms[i].n *= BANDIT_DISCOUNT;
+    bandit->arms[i].sum *= BANDIT_DISCOUNT;
+    bandit->arms[i].sum2 *= BANDIT_DISCOUNT;
+  }
+  bandit->t = bandit->t * BANDIT_DISCOUNT + 1;
+  bandit->arms[arm].n += 1;
+  bandit->arms[arm].sum += reward;
+  bandit->arms[arm].sum2 += reward * reward;
+}
+
+int btune_bandit_best(btune_bandit *bandit) {
+  int best = -1;
+  double best_mean = -DBL_MAX;
+  for (int i = 0; i < bandit->narms; i++) {
+    btune_arm *arm = &bandit->arms[i];
+    if (arm->n > 0 && arm->sum / arm->n > best_mean) {
+      best_mean = arm->sum / arm->n;
+      best = i;
+    }
+  }
+  return best;
+}
+
+void btune_bandit_reset(btune_bandit *bandit) {
+  for (int i = 0; i < bandit->narms; i++) {
+    bandit->arms[i].n = 0;
+    bandit->arms[i].sum = 0;
+    bandit->arms[i].sum2 = 0;
+  }
+  bandit->t = 0;
+}
+
+void btune_bandit_free(btune_bandit *bandit) {
+  if (bandit == NULL) {
+    return;
+  }
+  free(bandit->arms);
+  free(bandit);
+}
@@ -0,0 +1,91 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_bandit.h
+ * @brief Bandit search engine.
+ *
+ * Multi-armed bandit (UCB or Thompson sampling) over the whole
+ * (codec, filter, split, clevel, nthreads) space.  Rewards are discounted,
+ * so that exploration never stops completely on long-running streams.
+ */
+
+#ifndef BTUNE_BANDIT_H
+#define BTUNE_BANDIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "btune_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A combination of cparams and its (discounted) reward statistics
+typedef struct {
+  int compcode;
+  int filter;
+  // Index of the filter pipeline
+  int32_t splitmode;
+  int clevel;
+  int nthreads;
+  int family;
+  // Index of the (codec, filter, split) family of the arm
+  bool representative;
+  // Whether this arm is the first one to be tried in its family
+  double n;
+  // Discounted number of pulls
+  double sum;
+  // Discounted sum of rewards
+  double sum2;
+  // Discounted sum of squared rewards
+} btune_arm;
+
+typedef struct {
+  btune_search_strategy strategy;
+  btune_arm *arms;
+  int narms;
+  int nfamilies;
+  double t;
+  // Discounted total number of pulls
+  uint32_t seed;
+  // Seed for Thompson sampling
+} btune_bandit;
+
+// Create a bandit with all the combinations of the given parameters (filters are
+// given as the number of pipelines, the arms keep the index).  The arms with
+// `start_clevel` and `start_nthreads` are the first ones tried in every family.
+btune_bandit *btune_bandit_new(btune_search_strategy strategy,
+                               const int *codecs, int ncodecs,
+                               int nfilters,
+                               const int32_t *splitmodes, int nsplitmodes,
+                               const uint8_t *clevels, int nclevels,
+                               const int *nthreads, int nnthreads,
+                               int start_clevel, int start_nthreads);
+
+// Choose the next arm to try (-1 on failure)
+int btune_bandit_select(btune_bandit *bandit);
+
+// Feed the reward (the larger the better) obtained with `arm`
+void btune_bandit_update(btune_bandit *bandit, int arm, double reward);
+
+// The arm with the best mean reward (-1 if none has been tried yet)
+int btune_bandit_best(btune_bandit *bandit);
+
+// Forget all the rewards, e.g. after a change in the data
+void btune_bandit_reset(btune_bandit *bandit);
+
+void btune_bandit_free(btune_bandit *bandit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_BANDIT_H */
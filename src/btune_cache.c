@@ -0,0 +1,147 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <sys/types.h>
+  #include <sys/sysctl.h>
+#else
+  #include <unistd.h>
+#endif
+
+#include "btune_cache.h"
+
+
+#if defined(_WIN32)
+
+static int64_t detect_cache_size(int level) {
+  DWORD len = 0;
+  GetLogicalProcessorInformation(NULL, &len);
+  SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = malloc(len);
+  if (info == NULL || !GetLogicalProcessorInformation(info, &len)) {
+    free(info);
+    return 0;
+  }
+  int64_t size = 0;
+  DWORD n = len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+  for (DWORD i = 0; i < n; i++) {
+    if (info[i].Relationship == RelationCache && info[i].Cache.Level == level &&
+        (info[i].Cache.Type == CacheData || info[i].Cache.Type == CacheUnified)) {
+      size = info[i].Cache.Size;
+      break;
+    }
+  }
+  free(info);
+  return size;
+}
+
+#elif defined(__APPLE__)
+
+static int64_t detect_cache_size(int level) {
+  const char *names[] = {"hw.l1dcachesize", "hw.l2cachesize", "hw.l3cachesize"};
+  int64_t size = 0;
+  size_t len = sizeof(size);
+  if (sysctlbyname(names[level - 1], &size, &len, NULL, 0) != 0) {
+    return 0;
+  }
+  return size;
+}
+
+#else
+
+// Read the size from sysfs, for the libcs (or architectures) where sysconf does not know it
+static int64_t sysfs_cache_size(int level) {
+  char path[128];
+  for (int index = 0; index < 8; index++) {
+    int cache_level = 0;
+    char type[32] = "";
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+      break;
+    }
+    int nread = fscanf(file, "%d", &cache_level);
+    fclose(file);
+    if (nread != 1 || cache_level != level) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+    file = fopen(path, "r");
+    if (file != NULL) {
+      nread = fscanf(file, "%31s", type);
+      fclose(file);
+    }
+    if (type[0] == 'I') {
+      // Instruction cache
+      continue;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+    file = fopen(path, "r");
+    if (file == NULL) {
+      continue;
+    }
+    long size = 0;
+    char unit = 'K';
+    nread = fscanf(file, "%ld%c", &size, &unit);
+    fclose(file);
+    if (nread < 1) {
+      continue;
+    }
+    if (unit == 'K') {
+      size *= 1024;
+    } else if (unit == 'M') {
+      size *= 1024 * 1024;
+    }
+    return size;
+  }
+  return 0;
+}
+
+static int64_t detect_cache_size(int level) {
+  long size = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+  const int names[] = {_SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE};
+  size = sysconf(names[level - 1]);
+#endif
+  if (size <= 0) {
+    size = sysfs_cache_size(level);
+  }
+  return size;
+}
+
+#endif
+
+
+int32_t btune_cache_size(int level) {
+  static int32_t sizes[3] = {0, 0, 0};
+  const int32_t defaults[3] = {BTUNE_DEFAULT_L1, BTUNE_DEFAULT_L2, BTUNE_DEFAULT_L3};
+  if (level < 1 || level > 3) {
+    return 0;
+  }
+
+  if (sizes[level - 1] == 0) {
+    int64_t size = detect_cache_size(level);
+    if (size <= 0 && level == 3) {
+      // No L3, the L2 is the last level
+      size = btune_cache_size(2);
+    }
+    if (size <= 0 || size > INT32_MAX) {
+      size = defaults[level - 1];
+    }
+    sizes[level - 1] = (int32_t) size;
+  }
+
+  return sizes[level - 1];
+}
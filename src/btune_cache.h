@@ -0,0 +1,38 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_cache.h
+ * @brief CPU cache hierarchy detection.
+ */
+
+#ifndef BTUNE_CACHE_H
+#define BTUNE_CACHE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fallback sizes when the cache hierarchy cannot be detected
+#define BTUNE_DEFAULT_L1 (32 * 1024)
+#define BTUNE_DEFAULT_L2 (256 * 1024)
+#define BTUNE_DEFAULT_L3 (8 * 1024 * 1024)
+
+// Size in bytes of the data cache of `level` (1, 2 or 3) of the running CPU.
+// For level 3, the L2 size is returned when there is no L3.
+int32_t btune_cache_size(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_CACHE_H */
@@ -0,0 +1,397 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) && !defined(__GNUC__)
+  #include "win32/pthread.h"
+#else
+  #include <pthread.h>
+#endif
+#if !defined(_WIN32)
+  #include <unistd.h>
+#endif
+
+#include <blosc2.h>
+#include "btune_types.h"
+#include "btune_cache.h"
+#include "btune_calibrate.h"
+#include "btune_file.h"
+#include "entropy_probe.h"
+#include "json.h"
+
+// Version of the profile file format (and of the measurements)
+#define CALIBRATION_VERSION 1
+// Repetitions of every measurement (the fastest one is kept)
+#define CALIBRATION_NREPS 3
+
+static const int32_t sizes[BTUNE_CALIB_NSIZES] = {64 * 1024, 512 * 1024, 4 * 1024 * 1024};
+static const int32_t typesizes[BTUNE_CALIB_NTYPESIZES] = {1, 2, 4, 8};
+static const int codecs[BTUNE_CALIB_NCODECS] = {BLOSC_BLOSCLZ, BLOSC_LZ4, BLOSC_LZ4HC,
+                                                 BLOSC_ZLIB, BLOSC_ZSTD};
+static const int filters[BTUNE_CALIB_NFILTERS] = {BLOSC_SHUFFLE, BLOSC_BITSHUFFLE};
+
+// The profile of this process, obtained by the first btune_calibration_get()
+static btune_calibration g_calibration;
+static int g_calibration_state = 0;
+// 0 when not obtained yet, 1 when valid and -1 when the measurements failed
+static pthread_mutex_t g_calibration_mutex;
+// Guards the profile, as several contexts may be tuning from different threads
+static pthread_once_t g_calibration_once = PTHREAD_ONCE_INIT;
+
+
+static void init_calibration_mutex(void) {
+  pthread_mutex_init(&g_calibration_mutex, NULL);
+}
+
+// The profile is keyed by the host, as cache directories may be shared between machines
+static void profile_path(char *path, size_t size, const char *dir) {
+  char host[256] = {0};
+#if defined(_WIN32)
+  const char *name = getenv("COMPUTERNAME");
+  if (name != NULL) {
+    snprintf(host, sizeof(host), "%s", name);
+  }
+#else
+  gethostname(host, sizeof(host) - 1);
+#endif
+  int32_t machine[4] = {CALIBRATION_VERSION, btune_cache_size(1), btune_cache_size(2),
+                        btune_cache_size(3)};
+  uint64_t key = btune_fnv1a(BTUNE_FNV_OFFSET, host, strlen(host));
+  key = btune_fnv1a(key, machine, sizeof(machine));
+  snprintf(path, size, "%s/btune-calibration-%016" PRIx64 ".json", dir, key);
+}
+
+static int read_speeds(json_value *value, float *speeds) {
+  if (value->type != json_array || (int) value->u.array.length != BTUNE_CALIB_NSIZES) {
+    return -1;
+  }
+  for (int i = 0; i < BTUNE_CALIB_NSIZES; i++) {
+    json_value *item = value->u.array.values[i];
+    if (item->type == json_double) {
+      speeds[i] = (float) item->u.dbl;
+    }
+    else if (item->type == json_integer) {
+      speeds[i] = (float) item->u.integer;
+    }
+    else {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int load_profile(const char *path, btune_calibration *calibration) {
+  size_t nread;
+  char *buffer = btune_file_read(path, &nread);
+  if (buffer == NULL) {
+    return -1;
+  }
+  json_value *json = json_parse(buffer, nread);
+  free(buffer);
+  if (json == NULL) {
+    return -1;
+  }
+
+  // Every entry must be found, so that profiles of older versions are measured again
+  int nfound = 0;
+  int nexpected = 3 + BTUNE_CALIB_NCODECS + BTUNE_CALIB_NFILTERS * BTUNE_CALIB_NTYPESIZES;
+  int rc = (json->type == json_object) ? 0 : -1;
+  for (unsigned int i = 0; rc == 0 && i < json->u.object.length; i++) {
+    const char *name = json->u.object.values[i].name;
+    json_value *value = json->u.object.values[i].value;
+    char key[32];
+    if (strcmp(name, "version") == 0) {
+      rc = (value->type == json_integer && value->u.integer == CALIBRATION_VERSION) ? 0 : -1;
+      nfound++;
+      continue;
+    }
+    if (strcmp(name, "memcpy") == 0) {
+      rc = read_speeds(value, calibration->memcpy_speed);
+      nfound++;
+      continue;
+    }
+    if (strcmp(name, "zeros") == 0) {
+      rc = read_speeds(value, calibration->zeros_speed);
+      nfound++;
+      continue;
+    }
+    for (int c = 0; c < BTUNE_CALIB_NCODECS; c++) {
+      snprintf(key, sizeof(key), "codec_%d", codecs[c]);
+      if (strcmp(name, key) == 0) {
+        rc = read_speeds(value, calibration->codec_speed[c]);
+        nfound++;
+      }
+    }
+    for (int f = 0; f < BTUNE_CALIB_NFILTERS; f++) {
+      for (int t = 0; t < BTUNE_CALIB_NTYPESIZES; t++) {
+        snprintf(key, sizeof(key), "filter_%d_%d", filters[f], typesizes[t]);
+        if (strcmp(name, key) == 0) {
+          rc = read_speeds(value, calibration->filter_speed[f][t]);
+          nfound++;
+        }
+      }
+    }
+  }
+  json_value_free(json);
+
+  if (rc < 0 || nfound != nexpected) {
+    return -1;
+  }
+  return 0;
+}
+
+static void write_speeds(FILE *file, const char *name, const float *speeds, bool last) {
+  fprintf(file, "  \"%s\": [", name);
+  for (int i = 0; i < BTUNE_CALIB_NSIZES; i++) {
+    fprintf(file, (i == 0) ? "%.6g" : ", %.6g", speeds[i]);
+  }
+  fprintf(file, last ? "]\n" : "],\n");
+}
+
+static int save_profile(const char *path, const btune_calibration *calibration) {
+  char tmp_path[PATH_MAX + 96];
+  FILE *file = btune_file_create(path, tmp_path, sizeof(tmp_path));
+  if (file == NULL) {
+    return -1;
+  }
+  char key[32];
+  fprintf(file, "{\n");
+  fprintf(file, "  \"version\": %d,\n", CALIBRATION_VERSION);
+  write_speeds(file, "memcpy", calibration->memcpy_speed, false);
+  write_speeds(file, "zeros", calibration->zeros_speed, false);
+  for (int c = 0; c < BTUNE_CALIB_NCODECS; c++) {
+    snprintf(key, sizeof(key), "codec_%d", codecs[c]);
+    write_speeds(file, key, calibration->codec_speed[c], false);
+  }
+  for (int f = 0; f < BTUNE_CALIB_NFILTERS; f++) {
+    for (int t = 0; t < BTUNE_CALIB_NTYPESIZES; t++) {
+      snprintf(key, sizeof(key), "filter_%d_%d", filters[f], typesizes[t]);
+      bool last = f == BTUNE_CALIB_NFILTERS - 1 && t == BTUNE_CALIB_NTYPESIZES - 1;
+      write_speeds(file, key, calibration->filter_speed[f][t], last);
+    }
+  }
+  fprintf(file, "}\n");
+  return btune_file_commit(file, tmp_path, path);
+}
+
+// Slowly increasing values with some noise, a bit like a typical numeric series
+static void fill_series(uint8_t *buffer, int32_t size, int32_t typesize) {
+  uint32_t seed = 12345;
+  int32_t nelems = size / typesize;
+  for (int32_t i = 0; i < nelems; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint64_t value = (uint64_t) i * 3 + ((seed >> 16) & 0xF);
+    for (int32_t j = 0; j < typesize; j++) {
+      buffer[i * typesize + j] = (uint8_t) (value >> (8 * (j < 8 ? j : 7)));
+    }
+  }
+  memset(buffer + nelems * typesize, 0, size - nelems * typesize);
+}
+
+static double memcpy_secs(uint8_t *dest, const uint8_t *src, int32_t size) {
+  double best = -1;
+  for (int rep = 0; rep < CALIBRATION_NREPS; rep++) {
+    blosc_timestamp_t t0, t1;
+    blosc_set_timestamp(&t0);
+    memcpy(dest, src, size);
+    blosc_set_timestamp(&t1);
+    double secs = blosc_elapsed_secs(t0, t1);
+    if (best < 0 || secs < best) {
+      best = secs;
+    }
+  }
+  return best;
+}
+
+// Seconds for the fastest compression of `src` with a single thread (negative on errors)
+static double compress_secs(int compcode, int clevel, int filter, int32_t typesize,
+                            const uint8_t *src, int32_t size, uint8_t *dest) {
+  blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
+  cparams.compcode = (uint8_t) compcode;
+  cparams.clevel = (uint8_t) clevel;
+  cparams.typesize = typesize;
+  cparams.nthreads = 1;
+  cparams.filters[BLOSC2_MAX_FILTERS - 1] = (uint8_t) filter;
+  blosc2_context *cctx = blosc2_create_cctx(cparams);
+  if (cctx == NULL) {
+    return BLOSC2_ERROR_NULL_POINTER;
+  }
+  double best = -1;
+  for (int rep = 0; rep < CALIBRATION_NREPS; rep++) {
+    blosc_timestamp_t t0, t1;
+    blosc_set_timestamp(&t0);
+    int csize = blosc2_compress_ctx(cctx, src, size, dest, size + BLOSC2_MAX_OVERHEAD);
+    blosc_set_timestamp(&t1);
+    if (csize < 0) {
+      blosc2_free_ctx(cctx);
+      return csize;
+    }
+    double secs = blosc_elapsed_secs(t0, t1);
+    if (best < 0 || secs < best) {
+      best = secs;
+    }
+  }
+  blosc2_free_ctx(cctx);
+  return best;
+}
+
+static int measure_profile(btune_calibration *calibration) {
+  int32_t maxsize = sizes[BTUNE_CALIB_NSIZES - 1];
+  uint8_t *src = malloc(maxsize);
+  uint8_t *dest = malloc(maxsize + BLOSC2_MAX_OVERHEAD);
+  if (src == NULL || dest == NULL) {
+    free(src);
+    free(dest);
+    return BLOSC2_ERROR_MEMORY_ALLOC;
+  }
+
+  int rc = 0;
+  for (int s = 0; rc == 0 && s < BTUNE_CALIB_NSIZES; s++) {
+    int32_t size = sizes[s];
+    fill_series(src, size, 4);
+    calibration->memcpy_speed[s] = (float) (size / memcpy_secs(dest, src, size));
+    // The same measure the relative speeds of the models are trained with
+    calibration->zeros_speed[s] = get_zeros_speed(size);
+    if (calibration->zeros_speed[s] < 0) {
+      rc = (int) calibration->zeros_speed[s];
+      break;
+    }
+    for (int c = 0; c < BTUNE_CALIB_NCODECS; c++) {
+      double secs = compress_secs(codecs[c], 5, BLOSC_NOFILTER, 4, src, size, dest);
+      if (secs < 0) {
+        // A codec may not be available in this build of blosc2
+        calibration->codec_speed[c][s] = -1;
+        continue;
+      }
+      calibration->codec_speed[c][s] = (float) (size / secs);
+    }
+
+    // Filters change how compressible the data is, so they are timed together with
+    // the fastest codec instead of subtracting the time of the codec alone
+    for (int t = 0; rc == 0 && t < BTUNE_CALIB_NTYPESIZES; t++) {
+      fill_series(src, size, typesizes[t]);
+      for (int f = 0; f < BTUNE_CALIB_NFILTERS; f++) {
+        double secs = compress_secs(BLOSC_LZ4, 1, filters[f], typesizes[t], src, size, dest);
+        if (secs < 0) {
+          rc = (int) secs;
+          break;
+        }
+        calibration->filter_speed[f][t][s] = (float) (size / secs);
+      }
+    }
+  }
+
+  free(src);
+  free(dest);
+  return rc;
+}
+
+// Read the profile from `dir` (if given), or measure it and save it there.
+// Returns 1 if the profile is valid and -1 if the measurements failed.
+static int obtain_profile(const char *dir) {
+  // Nothing is stored unless a cache directory has been given
+  char path[PATH_MAX + 64] = {0};
+  bool has_path = dir != NULL && dir[0] != '\0';
+  if (has_path) {
+    profile_path(path, sizeof(path), dir);
+  }
+  const char *recalibrate = getenv("BTUNE_RECALIBRATE");
+  bool force = recalibrate != NULL && atoi(recalibrate) != 0;
+  if (has_path && !force && load_profile(path, &g_calibration) == 0) {
+    BTUNE_TRACE("Calibration profile loaded from %s", path);
+    return 1;
+  }
+
+  blosc_timestamp_t t0, t1;
+  blosc_set_timestamp(&t0);
+  int rc = measure_profile(&g_calibration);
+  blosc_set_timestamp(&t1);
+  if (rc < 0) {
+    fprintf(stderr, "Error %d calibrating the machine\n", rc);
+    return -1;
+  }
+  if (has_path && save_profile(path, &g_calibration) == 0) {
+    BTUNE_TRACE("Calibration profile measured in %f s and saved to %s",
+                blosc_elapsed_secs(t0, t1), path);
+  }
+  else {
+    BTUNE_TRACE("Calibration profile measured in %f s (not saved)", blosc_elapsed_secs(t0, t1));
+  }
+  return 1;
+}
+
+const btune_calibration *btune_calibration_get(const char *dir) {
+  pthread_once(&g_calibration_once, init_calibration_mutex);
+  // The other threads wait for the first one to obtain the profile
+  pthread_mutex_lock(&g_calibration_mutex);
+  if (g_calibration_state == 0) {
+    g_calibration_state = obtain_profile(dir);
+  }
+  int state = g_calibration_state;
+  pthread_mutex_unlock(&g_calibration_mutex);
+  return (state > 0) ? &g_calibration : NULL;
+}
+
+// Interpolation on log2(size) between the measured sizes (clamped to them)
+static float interpolate(const float *speeds, int32_t size) {
+  if (size <= sizes[0]) {
+    return speeds[0];
+  }
+  for (int s = 1; s < BTUNE_CALIB_NSIZES; s++) {
+    if (size <= sizes[s]) {
+      if (speeds[s - 1] < 0 || speeds[s] < 0) {
+        return -1;
+      }
+      double x = log2((double) size / sizes[s - 1]) / log2((double) sizes[s] / sizes[s - 1]);
+      return (float) (speeds[s - 1] + x * (speeds[s] - speeds[s - 1]));
+    }
+  }
+  return speeds[BTUNE_CALIB_NSIZES - 1];
+}
+
+float btune_calibration_zeros_speed(const btune_calibration *calibration, int32_t size) {
+  return interpolate(calibration->zeros_speed, size);
+}
+
+float btune_calibration_memcpy_speed(const btune_calibration *calibration, int32_t size) {
+  return interpolate(calibration->memcpy_speed, size);
+}
+
+float btune_calibration_codec_speed(const btune_calibration *calibration, int compcode,
+                                    int32_t size) {
+  for (int c = 0; c < BTUNE_CALIB_NCODECS; c++) {
+    if (codecs[c] == compcode) {
+      return interpolate(calibration->codec_speed[c], size);
+    }
+  }
+  return -1;
+}
+
+float btune_calibration_filter_speed(const btune_calibration *calibration, int filter,
+                                     int32_t typesize, int32_t size) {
+  // The closest measured typesize not larger than the given one
+  int t = 0;
+  while (t + 1 < BTUNE_CALIB_NTYPESIZES && typesizes[t + 1] <= typesize) {
+    t++;
+  }
+  for (int f = 0; f < BTUNE_CALIB_NFILTERS; f++) {
+    if (filters[f] == filter) {
+      return interpolate(calibration->filter_speed[f][t], size);
+    }
+  }
+  return -1;
+}
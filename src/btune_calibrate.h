@@ -0,0 +1,74 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_calibrate.h
+ * @brief Calibration profile of the machine, cached on disk.
+ *
+ * The memory bandwidth, the speed of compressing a zeros chunk (the reference
+ * for the relative speeds the models are trained with) and the throughput of
+ * every codec and shuffle filter are measured at a few buffer sizes.  The
+ * profile can be stored in a small JSON file keyed by the host, so that it is
+ * only measured once per machine instead of once per process.
+ */
+
+#ifndef BTUNE_CALIBRATE_H
+#define BTUNE_CALIBRATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Buffer sizes of the measurements
+#define BTUNE_CALIB_NSIZES 3
+// Typesizes of the filter measurements (1, 2, 4 and 8 bytes)
+#define BTUNE_CALIB_NTYPESIZES 4
+// Codecs measured (BLOSCLZ, LZ4, LZ4HC, ZLIB and ZSTD)
+#define BTUNE_CALIB_NCODECS 5
+// Filters measured (SHUFFLE and BITSHUFFLE)
+#define BTUNE_CALIB_NFILTERS 2
+
+// Machine profile, with all the speeds in bytes per second
+typedef struct {
+  float memcpy_speed[BTUNE_CALIB_NSIZES];
+  float zeros_speed[BTUNE_CALIB_NSIZES];
+  float codec_speed[BTUNE_CALIB_NCODECS][BTUNE_CALIB_NSIZES];
+  // Compression at clevel 5, without filters
+  float filter_speed[BTUNE_CALIB_NFILTERS][BTUNE_CALIB_NTYPESIZES][BTUNE_CALIB_NSIZES];
+  // Compression with LZ4 at clevel 1 after the filter
+} btune_calibration;
+
+// The profile of the machine.  It is read from `dir`, or measured and saved
+// there when missing (when `dir` is empty it is just measured).  This is done
+// only once per process, from the first calling thread, while the rest wait
+// for it.  Returns NULL if the measurements failed.
+const btune_calibration *btune_calibration_get(const char *dir);
+
+// Speed of compressing a zeros chunk of `size` bytes
+float btune_calibration_zeros_speed(const btune_calibration *calibration, int32_t size);
+
+// Memory bandwidth for buffers of `size` bytes
+float btune_calibration_memcpy_speed(const btune_calibration *calibration, int32_t size);
+
+// Compression speed of `compcode` for chunks of `size` bytes (-1 if not measured)
+float btune_calibration_codec_speed(const btune_calibration *calibration, int compcode,
+                                    int32_t size);
+
+// Speed of `filter` for chunks of `size` bytes of `typesize` elements (-1 if not measured)
+float btune_calibration_filter_speed(const btune_calibration *calibration, int filter,
+                                     int32_t typesize, int32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_CALIBRATE_H */
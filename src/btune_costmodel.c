@@ -0,0 +1,196 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include <blosc2.h>
+#include "btune_costmodel.h"
+#include "entropy_filters.h"
+
+// Step of the normalized least mean squares
+#define LEARNING_RATE 0.5
+// Bounds of the filter gains predicted from the entropies
+#define MAX_FILTER_GAIN 8.
+#define MIN_BITS 0.05
+
+enum {
+  FEATURE_BIAS,
+  FEATURE_CLEVEL,
+  FEATURE_NTHREADS,
+  FEATURE_BLOCKSIZE,
+  FEATURE_SHUFFLE,
+  FEATURE_BITSHUFFLE,
+  FEATURE_SPLIT,
+};
+
+static const int codecs[BTUNE_COST_NCODECS] = {BLOSC_BLOSCLZ, BLOSC_LZ4, BLOSC_LZ4HC,
+                                                BLOSC_ZLIB, BLOSC_ZSTD};
+// Typical single thread compression speeds (bytes/s), for when there is no calibration
+static const float default_speeds[BTUNE_COST_NCODECS] = {1e9f, 1.5e9f, 5e7f, 5e7f, 1e8f};
+static const float default_filter_speeds[2] = {2e9f, 1e9f};
+// How much faster decompression is than compression at clevel 5
+static const double decomp_speedups[BTUNE_COST_NCODECS] = {3, 3, 40, 6, 8};
+// How much the clevel (from 1 to 9) grows the log of the cratio and of the ctime
+static const double clevel_cratio[BTUNE_COST_NCODECS] = {0.1, 0.05, 0.15, 0.15, 0.2};
+static const double clevel_ctime[BTUNE_COST_NCODECS] = {0.3, 0.3, 1.0, 1.0, 1.2};
+
+
+static int codec_index(int compcode) {
+  for (int c = 0; c < BTUNE_COST_NCODECS; c++) {
+    if (codecs[c] == compcode) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+void btune_costmodel_init(btune_costmodel *model) {
+  memset(model, 0, sizeof(btune_costmodel));
+  for (int c = 0; c < BTUNE_COST_NCODECS; c++) {
+    model->weights[c][BTUNE_COST_CRATIO][FEATURE_CLEVEL] = clevel_cratio[c];
+    model->weights[c][BTUNE_COST_CTIME][FEATURE_CLEVEL] = clevel_ctime[c];
+    // Threads do not scale perfectly
+    model->weights[c][BTUNE_COST_CTIME][FEATURE_NTHREADS] = -0.8 * log(2.);
+    model->weights[c][BTUNE_COST_DTIME][FEATURE_NTHREADS] = -0.8 * log(2.);
+  }
+}
+
+void btune_costmodel_set_chunk(btune_costmodel *model, const uint8_t *src, int32_t size,
+                               int32_t typesize, const btune_calibration *calibration) {
+  model->typesize = typesize;
+  if (entropy_codecs_probe(src, size, model->codec_cratios) < 0) {
+    for (int i = 0; i < ENTROPY_NCODECS; i++) {
+      model->codec_cratios[i] = 1;
+    }
+  }
+  entropy_filters_features features;
+  entropy_filters_probe(src, size, typesize, &features);
+  const uint8_t filters[3] = {BLOSC_NOFILTER, BLOSC_SHUFFLE, BLOSC_BITSHUFFLE};
+  for (int f = 0; f < 3; f++) {
+    model->filter_bits[f] = entropy_filters_estimate(&features, filters[f]);
+  }
+
+  for (int c = 0; c < BTUNE_COST_NCODECS; c++) {
+    float speed = -1;
+    if (calibration != NULL) {
+      speed = btune_calibration_codec_speed(calibration, codecs[c], size);
+    }
+    model->codec_speeds[c] = (speed > 0) ? speed : default_speeds[c];
+  }
+  for (int f = 0; f < 2; f++) {
+    float speed = -1;
+    if (calibration != NULL) {
+      speed = btune_calibration_filter_speed(calibration, filters[f + 1], typesize, size);
+    }
+    model->filter_speeds[f] = (speed > 0) ? speed : default_filter_speeds[f];
+  }
+  model->has_chunk = true;
+}
+
+static void get_features(const btune_cost_params *params, int nthreads, double *x) {
+  int32_t blocksize = (params->blocksize > 0) ? params->blocksize : 256 * 1024;
+  x[FEATURE_BIAS] = 1;
+  x[FEATURE_CLEVEL] = (params->clevel - 5) / 4.;
+  x[FEATURE_NTHREADS] = log2(nthreads > 0 ? nthreads : 1);
+  x[FEATURE_BLOCKSIZE] = log2(blocksize / (256. * 1024));
+  x[FEATURE_SHUFFLE] = params->filter == BLOSC_SHUFFLE;
+  x[FEATURE_BITSHUFFLE] = params->filter == BLOSC_BITSHUFFLE;
+  x[FEATURE_SPLIT] = params->splitmode == BLOSC_ALWAYS_SPLIT;
+}
+
+// The logs of the cratio, ctime and dtime predicted from the chunk and the machine alone
+static void get_priors(const btune_costmodel *model, int c, const btune_cost_params *params,
+                       double *priors) {
+  int family = entropy_codecs_family(codecs[c]);
+  double log_cratio = log(model->codec_cratios[family]);
+  if (codecs[c] == BLOSC_LZ4HC) {
+    // A better parser than the one of LZ4
+    log_cratio += log(1.1);
+  }
+  double log_ctime = -log(model->codec_speeds[c]);
+  int f = (params->filter == BLOSC_SHUFFLE) ? 1 : (params->filter == BLOSC_BITSHUFFLE) ? 2 : 0;
+  if (f > 0 && !(f == 1 && model->typesize == 1)) {
+    double bits = (model->filter_bits[0] > MIN_BITS) ? model->filter_bits[0] : MIN_BITS;
+    double filter_bits = (model->filter_bits[f] > MIN_BITS) ? model->filter_bits[f] : MIN_BITS;
+    double gain = log(bits / filter_bits);
+    if (fabs(gain) > log(MAX_FILTER_GAIN)) {
+      gain = (gain > 0) ? log(MAX_FILTER_GAIN) : -log(MAX_FILTER_GAIN);
+    }
+    log_cratio += gain;
+    // Filtering takes its time before (and after) the codec
+    log_ctime += log(1 + model->codec_speeds[c] / model->filter_speeds[f - 1]);
+  }
+  priors[BTUNE_COST_CRATIO] = log_cratio;
+  priors[BTUNE_COST_CTIME] = log_ctime;
+  priors[BTUNE_COST_DTIME] = log_ctime - log(decomp_speedups[c]);
+}
+
+static double dot(const double *w, const double *x) {
+  double sum = 0;
+  for (int i = 0; i < BTUNE_COST_NFEATURES; i++) {
+    sum += w[i] * x[i];
+  }
+  return sum;
+}
+
+int btune_costmodel_predict(const btune_costmodel *model, const btune_cost_params *params,
+                            btune_cost_prediction *prediction) {
+  int c = codec_index(params->compcode);
+  if (c < 0 || !model->has_chunk) {
+    return -1;
+  }
+  double priors[BTUNE_COST_NMETRICS];
+  get_priors(model, c, params, priors);
+  double x[BTUNE_COST_NFEATURES];
+  get_features(params, params->nthreads_comp, x);
+  // The cratio does not depend on the threads
+  x[FEATURE_NTHREADS] = 0;
+  double log_cratio = priors[BTUNE_COST_CRATIO] + dot(model->weights[c][BTUNE_COST_CRATIO], x);
+  prediction->cratio = (log_cratio > 0) ? exp(log_cratio) : 1;
+  get_features(params, params->nthreads_comp, x);
+  prediction->ctime = exp(priors[BTUNE_COST_CTIME] + dot(model->weights[c][BTUNE_COST_CTIME], x));
+  get_features(params, params->nthreads_decomp, x);
+  prediction->dtime = exp(priors[BTUNE_COST_DTIME] + dot(model->weights[c][BTUNE_COST_DTIME], x));
+  return 0;
+}
+
+// One step of normalized least mean squares on the log of `value`
+static void learn(double *w, const double *x, double prior, double value) {
+  double error = log(value) - (prior + dot(w, x));
+  double norm = dot(x, x);
+  for (int i = 0; i < BTUNE_COST_NFEATURES; i++) {
+    w[i] += LEARNING_RATE * error * x[i] / norm;
+  }
+}
+
+void btune_costmodel_update(btune_costmodel *model, const btune_cost_params *params,
+                            double cratio, double ctime, double dtime) {
+  int c = codec_index(params->compcode);
+  if (c < 0 || !model->has_chunk || cratio <= 0) {
+    return;
+  }
+  double priors[BTUNE_COST_NMETRICS];
+  get_priors(model, c, params, priors);
+  double x[BTUNE_COST_NFEATURES];
+  get_features(params, params->nthreads_comp, x);
+  x[FEATURE_NTHREADS] = 0;
+  learn(model->weights[c][BTUNE_COST_CRATIO], x, priors[BTUNE_COST_CRATIO], cratio);
+  if (ctime > 0) {
+    get_features(params, params->nthreads_comp, x);
+    learn(model->weights[c][BTUNE_COST_CTIME], x, priors[BTUNE_COST_CTIME], ctime);
+  }
+  if (dtime > 0) {
+    get_features(params, params->nthreads_decomp, x);
+    learn(model->weights[c][BTUNE_COST_DTIME], x, priors[BTUNE_COST_DTIME], dtime);
+  }
+  model->nupdates++;
+}
@@ -0,0 +1,107 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_costmodel.h
+ * @brief Analytical model of the cratio, ctime and dtime of untried cparams.
+ *
+ * The logs of the cratio, ctime and dtime of every codec are predicted as a
+ * prior, which comes from the probes of the chunk (the per-codec cratio
+ * estimates and the filter entropies) and from the calibration profile of the
+ * machine, plus a linear correction on the clevel, nthreads, blocksize,
+ * filter and split.  The corrections are learnt online (with normalized least
+ * mean squares) from the real measurements of the tuner.
+ */
+
+#ifndef BTUNE_COSTMODEL_H
+#define BTUNE_COSTMODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "btune_calibrate.h"
+#include "entropy_codecs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Codecs modelled (BLOSCLZ, LZ4, LZ4HC, ZLIB and ZSTD)
+#define BTUNE_COST_NCODECS 5
+// Features of the linear correction: bias, clevel, nthreads, blocksize, shuffle,
+// bitshuffle and split
+#define BTUNE_COST_NFEATURES 7
+
+typedef enum {
+  BTUNE_COST_CRATIO,
+  BTUNE_COST_CTIME,
+  BTUNE_COST_DTIME,
+  BTUNE_COST_NMETRICS,
+} btune_cost_metric;
+
+// The cparams a prediction is made for
+typedef struct {
+  int compcode;
+  uint8_t filter;
+  int32_t splitmode;
+  int clevel;
+  int32_t blocksize;
+  // 0 for automatic
+  int nthreads_comp;
+  int nthreads_decomp;
+} btune_cost_params;
+
+typedef struct {
+  double cratio;
+  double ctime;
+  // Seconds per byte
+  double dtime;
+  // Seconds per byte
+} btune_cost_prediction;
+
+typedef struct {
+  bool has_chunk;
+  // Whether the features of a chunk have been set
+  int32_t typesize;
+  float codec_cratios[ENTROPY_NCODECS];
+  // Cratio estimates of the chunk for every codec family
+  float filter_bits[3];
+  // Estimated bits per byte of the chunk with NOFILTER, SHUFFLE and BITSHUFFLE
+  float codec_speeds[BTUNE_COST_NCODECS];
+  // Compression speeds of the machine for the chunk size
+  float filter_speeds[2];
+  // Speeds of the machine for SHUFFLE and BITSHUFFLE, for the chunk size and typesize
+  double weights[BTUNE_COST_NCODECS][BTUNE_COST_NMETRICS][BTUNE_COST_NFEATURES];
+  // Coefficients of the linear corrections
+  int nupdates;
+  // Number of measurements learnt from
+} btune_costmodel;
+
+// Set the initial coefficients
+void btune_costmodel_init(btune_costmodel *model);
+
+// Probe the chunk the next predictions are made for.  The calibration may be
+// NULL, and typical speeds are used then.
+void btune_costmodel_set_chunk(btune_costmodel *model, const uint8_t *src, int32_t size,
+                               int32_t typesize, const btune_calibration *calibration);
+
+// Predict the cratio, ctime and dtime of `params` for the chunk set.  Returns 0 on
+// success, or -1 if the codec is not modelled or no chunk has been set.
+int btune_costmodel_predict(const btune_costmodel *model, const btune_cost_params *params,
+                            btune_cost_prediction *prediction);
+
+// Learn from the measurements of `params` (a ctime or dtime of 0 is not learnt from)
+void btune_costmodel_update(btune_costmodel *model, const btune_cost_params *params,
+                            double cratio, double ctime, double dtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_COSTMODEL_H */
@@ -0,0 +1,79 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "btune_drift.h"
+
+// Number of chunks used for estimating the baseline
+#define DRIFT_WARMUP 4
+// Slack of the CUSUM (in standard deviations)
+#define DRIFT_SLACK 0.5
+// Threshold of the CUSUM (in standard deviations)
+#define DRIFT_THRESHOLD 5.0
+
+// Minimum deviations (in log scale), so that a few very stable chunks do not
+// make the detector fire on noise.  Timings are much noisier than ratios.
+static const double min_std[BTUNE_DRIFT_NSTATS] = {
+  0.02,  // cratio
+  0.15,  // score
+  0.02,  // probe
+};
+
+
+void btune_drift_reset(btune_drift *drift) {
+  memset(drift, 0, sizeof(btune_drift));
+}
+
+int btune_drift_update(btune_drift *drift, const double *values) {
+  int changed = -1;
+  for (int i = 0; i < BTUNE_DRIFT_NSTATS; i++) {
+    double x = values[i];
+    if (!isfinite(x)) {
+      continue;
+    }
+    if (drift->nobs[i] < DRIFT_WARMUP) {
+      // Welford's algorithm for the baseline
+      drift->nobs[i]++;
+      double delta = x - drift->mean[i];
+      drift->mean[i] += delta / drift->nobs[i];
+      drift->m2[i] += delta * (x - drift->mean[i]);
+      continue;
+    }
+
+    double std = sqrt(drift->m2[i] / (drift->nobs[i] - 1));
+    if (std < min_std[i]) {
+      std = min_std[i];
+    }
+    double z = (x - drift->mean[i]) / std;
+    drift->pos[i] = fmax(0, drift->pos[i] + z - DRIFT_SLACK);
+    drift->neg[i] = fmax(0, drift->neg[i] - z - DRIFT_SLACK);
+    if (changed < 0 && (drift->pos[i] > DRIFT_THRESHOLD || drift->neg[i] > DRIFT_THRESHOLD)) {
+      changed = i;
+    }
+  }
+
+  return changed;
+}
+
+const char *btune_drift_stat_to_str(int stat) {
+  switch (stat) {
+    case BTUNE_DRIFT_CRATIO:
+      return "cratio";
+    case BTUNE_DRIFT_SCORE:
+      return "score";
+    case BTUNE_DRIFT_PROBE:
+      return "probe";
+    default:
+      return "unknown";
+  }
+}
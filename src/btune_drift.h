@@ -0,0 +1,64 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_drift.h
+ * @brief Data drift detection.
+ *
+ * Two-sided CUSUM change point detection over a few cheap per-chunk
+ * statistics.  The baseline (mean and deviation) of every statistic is
+ * estimated from the first chunks after a reset.
+ */
+
+#ifndef BTUNE_DRIFT_H
+#define BTUNE_DRIFT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The statistics watched for drift (in log scale)
+typedef enum {
+  BTUNE_DRIFT_CRATIO,
+  // The cratio of the chunk
+  BTUNE_DRIFT_SCORE,
+  // The score per byte of the chunk
+  BTUNE_DRIFT_PROBE,
+  // The cratio estimated by the entropy probe
+  BTUNE_DRIFT_NSTATS,
+} btune_drift_stat;
+
+typedef struct {
+  int nobs[BTUNE_DRIFT_NSTATS];
+  // Number of observations since the last reset
+  double mean[BTUNE_DRIFT_NSTATS];
+  // Baseline mean
+  double m2[BTUNE_DRIFT_NSTATS];
+  // Sum of squared deviations of the baseline
+  double pos[BTUNE_DRIFT_NSTATS];
+  // CUSUM for increases
+  double neg[BTUNE_DRIFT_NSTATS];
+  // CUSUM for decreases
+} btune_drift;
+
+// Forget the baseline and the cumulative sums
+void btune_drift_reset(btune_drift *drift);
+
+// Feed the statistics of a new chunk (NAN values are skipped).  Returns the
+// statistic that detected a change point, or -1 if there is none.
+int btune_drift_update(btune_drift *drift, const double *values);
+
+const char *btune_drift_stat_to_str(int stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_DRIFT_H */
@@ -0,0 +1,74 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "btune_file.h"
+
+#define FNV_PRIME 1099511628211ULL
+
+
+uint64_t btune_fnv1a(uint64_t hash, const void *data, size_t len) {
+  const uint8_t *bytes = (const uint8_t *) data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+char *btune_file_read(const char *path, size_t *len) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size <= 0) {
+    fclose(file);
+    return NULL;
+  }
+  char *buffer = malloc(size + 1);
+  if (buffer == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  size_t nread = fread(buffer, 1, size, file);
+  fclose(file);
+  buffer[nread] = 0;
+  *len = nread;
+  return buffer;
+}
+
+FILE *btune_file_create(const char *path, char *tmp_path, size_t size) {
+  snprintf(tmp_path, size, "%s.%lx.tmp", path,
+           (unsigned long) ((uintptr_t) tmp_path ^ (uintptr_t) time(NULL)));
+  return fopen(tmp_path, "wt");
+}
+
+int btune_file_commit(FILE *file, const char *tmp_path, const char *path) {
+  if (fclose(file) != 0) {
+    remove(tmp_path);
+    return -1;
+  }
+
+#if defined(_WIN32)
+  // rename() does not replace existing files on Windows
+  remove(path);
+#endif
+  if (rename(tmp_path, path) != 0) {
+    remove(tmp_path);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_file.h
+ * @brief Helpers for the small files of the on-disk caches.
+ *
+ * The tuning cache and the calibration profile are small JSON files named
+ * after a hash, which may be read and written by several processes at once.
+ */
+
+#ifndef BTUNE_FILE_H
+#define BTUNE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Initial value of the FNV-1a hashes
+#define BTUNE_FNV_OFFSET 14695981039346656037ULL
+
+// Feed `len` bytes of `data` into the FNV-1a `hash`
+uint64_t btune_fnv1a(uint64_t hash, const void *data, size_t len);
+
+// Read the whole file into a NUL-terminated buffer to be freed by the caller,
+// storing its length in `len`.  Returns NULL if missing, empty or on errors.
+char *btune_file_read(const char *path, size_t *len);
+
+// Open a temporary file for writing `path`, whose name is stored in `tmp_path`
+// (at least 32 bytes longer than `path`).  Returns NULL on errors.
+FILE *btune_file_create(const char *path, char *tmp_path, size_t size);
+
+// Close the file opened by btune_file_create() and move it to `path`, so that
+// concurrent readers never see partial files.  Returns 0 on success.
+int btune_file_commit(FILE *file, const char *tmp_path, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_FILE_H */
@@ -39,9 +39,48 @@ BLOSC2_BTUNE_EXPORT int set_params_defaults(
     uint32_t nwaits,
     uint32_t nsofts,
     uint32_t nhards,
-    uint32_t repeat_mode
+    uint32_t repeat_mode,
+    bool speculative,
+    uint32_t sampling_mode,
+    int sample_nblocks,
+    uint32_t search,
+    bool drift_detection,
+    int nreps,
+    uint32_t aggregation,
+    int nwarmups,
+    const char* cache_dir,
+    bool persist_state,
+    bool async_dtime,
+    int probe_budget,
+    bool filter_pruning,
+    bool codec_pruning,
+    int cost_model_topk,
+    bool sink_bandwidth,
+    float storage_latency,
+    uint32_t storage_iops,
+    int32_t storage_request_size,
+    float slo_ctime,
+    float slo_dtime,
+    uint32_t min_cspeed,
+    uint32_t min_dspeed
 );
 
+// Change the perf_mode and tradeoff of a context being tuned.  The new best cparams
+// are chosen from the Pareto front of the ones measured so far, so no new
+// exploration is needed (unless none of them has the needed measurements).
+BLOSC2_BTUNE_EXPORT int btune_set_performance(blosc2_context *context, uint32_t perf_mode,
+                                              float *tradeoff, int tradeoff_nelems);
+
+// Submit the chunk that will be compressed with `cctx` after the current one, so
+// that its entropy probe and inference run in a helper thread while the current
+// one is compressed.  `src` must keep the data unchanged until it is compressed.
+// Returns 1 if submitted, 0 when no inference is needed for it.
+BLOSC2_BTUNE_EXPORT int btune_lookahead(blosc2_context *cctx, const void *src, int32_t srcsize);
+
+// Store the tuner state of `cctx` in the vlmeta of its super-chunk right away
+// (it is also stored when the context is freed, if persist_state is set).
+BLOSC2_BTUNE_EXPORT int btune_checkpoint(blosc2_context *cctx);
+
 BLOSC2_BTUNE_EXPORT void btune_free_all_models(void);
 
 BLOSC2_BTUNE_EXPORT void btune_set_reuse_models(bool new_value);
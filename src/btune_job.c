@@ -0,0 +1,115 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if defined(_WIN32) && !defined(__GNUC__)
+  #include "win32/pthread.h"
+#else
+  #include <pthread.h>
+#endif
+
+#include "btune_job.h"
+
+
+struct btune_job_s {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cv;
+  // Signals a new job (or the end of the thread)
+  pthread_cond_t done_cv;
+  // Signals that the job has finished
+  btune_job_fn fn;
+  void *arg;
+  bool busy;
+  // Whether a job has been submitted and has not finished yet
+  bool end;
+};
+
+
+static void *job_main(void *arg) {
+  btune_job *job = (btune_job *) arg;
+
+  pthread_mutex_lock(&job->mutex);
+  while (true) {
+    while (!job->end && !job->busy) {
+      pthread_cond_wait(&job->work_cv, &job->mutex);
+    }
+    if (job->busy) {
+      pthread_mutex_unlock(&job->mutex);
+      job->fn(job->arg);
+      pthread_mutex_lock(&job->mutex);
+      job->busy = false;
+      pthread_cond_broadcast(&job->done_cv);
+      continue;
+    }
+    // No pending job and the end has been requested
+    break;
+  }
+  pthread_mutex_unlock(&job->mutex);
+
+  return NULL;
+}
+
+btune_job *btune_job_new(void) {
+  btune_job *job = calloc(1, sizeof(btune_job));
+  if (job == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&job->mutex, NULL);
+  pthread_cond_init(&job->work_cv, NULL);
+  pthread_cond_init(&job->done_cv, NULL);
+  if (pthread_create(&job->thread, NULL, job_main, job) != 0) {
+    pthread_mutex_destroy(&job->mutex);
+    pthread_cond_destroy(&job->work_cv);
+    pthread_cond_destroy(&job->done_cv);
+    free(job);
+    return NULL;
+  }
+
+  return job;
+}
+
+void btune_job_submit(btune_job *job, btune_job_fn fn, void *arg) {
+  pthread_mutex_lock(&job->mutex);
+  while (job->busy) {
+    pthread_cond_wait(&job->done_cv, &job->mutex);
+  }
+  job->fn = fn;
+  job->arg = arg;
+  job->busy = true;
+  pthread_cond_signal(&job->work_cv);
+  pthread_mutex_unlock(&job->mutex);
+}
+
+void btune_job_wait(btune_job *job) {
+  pthread_mutex_lock(&job->mutex);
+  while (job->busy) {
+    pthread_cond_wait(&job->done_cv, &job->mutex);
+  }
+  pthread_mutex_unlock(&job->mutex);
+}
+
+void btune_job_free(btune_job *job) {
+  if (job == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&job->mutex);
+  job->end = true;
+  pthread_cond_signal(&job->work_cv);
+  pthread_mutex_unlock(&job->mutex);
+  pthread_join(job->thread, NULL);
+  pthread_mutex_destroy(&job->mutex);
+  pthread_cond_destroy(&job->work_cv);
+  pthread_cond_destroy(&job->done_cv);
+  free(job);
+}
@@ -0,0 +1,46 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_job.h
+ * @brief Btune background job.
+ *
+ * A single persistent thread for running work off the critical path of
+ * the compression (e.g. timing the decompression of the last chunk).
+ */
+
+#ifndef BTUNE_JOB_H
+#define BTUNE_JOB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*btune_job_fn)(void *arg);
+
+typedef struct btune_job_s btune_job;
+
+// Create the background thread (NULL if it cannot be created)
+btune_job *btune_job_new(void);
+
+// Run `fn(arg)` in the background, after waiting for the previous job (if any)
+void btune_job_submit(btune_job *job, btune_job_fn fn, void *arg);
+
+// Wait until the submitted job (if any) has finished
+void btune_job_wait(btune_job *job);
+
+// Wait for the submitted job (if any) and stop the thread
+void btune_job_free(btune_job *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_JOB_H */
@@ -0,0 +1,63 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "btune_latency.h"
+
+// Lower edge of the first bin and bins per octave
+#define MIN_LATENCY 1e-6
+#define BINS_PER_OCTAVE 4
+
+
+void btune_latency_reset(btune_latency_hist *hist) {
+  memset(hist, 0, sizeof(btune_latency_hist));
+}
+
+static int latency_bin(double secs) {
+  if (!(secs > MIN_LATENCY)) {
+    return 0;
+  }
+  double bin = floor(BINS_PER_OCTAVE * log2(secs / MIN_LATENCY));
+  return (bin < BTUNE_LATENCY_NBINS - 1) ? (int) bin : BTUNE_LATENCY_NBINS - 1;
+}
+
+void btune_latency_add(btune_latency_hist *hist, double secs) {
+  if (hist->nvalues == BTUNE_LATENCY_WINDOW) {
+    hist->counts[hist->bins[hist->next]]--;
+  } else {
+    hist->nvalues++;
+  }
+  int bin = latency_bin(secs);
+  hist->bins[hist->next] = (uint8_t) bin;
+  hist->counts[bin]++;
+  hist->next = (hist->next + 1) % BTUNE_LATENCY_WINDOW;
+}
+
+double btune_latency_quantile(const btune_latency_hist *hist, double q) {
+  if (hist->nvalues == 0) {
+    return 0;
+  }
+  // The rank of the quantile, counting from 1
+  int rank = (int) ceil(q * hist->nvalues);
+  if (rank < 1) {
+    rank = 1;
+  }
+  int count = 0;
+  for (int bin = 0; bin < BTUNE_LATENCY_NBINS; bin++) {
+    count += hist->counts[bin];
+    if (count >= rank) {
+      return MIN_LATENCY * exp2((bin + 1.) / BINS_PER_OCTAVE);
+    }
+  }
+  return MIN_LATENCY * exp2((double) BTUNE_LATENCY_NBINS / BINS_PER_OCTAVE);
+}
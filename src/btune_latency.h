@@ -0,0 +1,57 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_latency.h
+ * @brief Rolling histogram of latencies.
+ *
+ * The latencies are counted in logarithmic bins (4 per octave, from 1 us to
+ * about 16 s), and only the last BTUNE_LATENCY_WINDOW ones are kept, so that
+ * the quantiles follow the recent behaviour of the machine.  The quantiles are
+ * the upper edges of their bins, so they never underestimate the latencies.
+ */
+
+#ifndef BTUNE_LATENCY_H
+#define BTUNE_LATENCY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BTUNE_LATENCY_NBINS 96
+#define BTUNE_LATENCY_WINDOW 256
+
+typedef struct {
+  uint16_t counts[BTUNE_LATENCY_NBINS];
+  // Latencies of the window in every bin
+  uint8_t bins[BTUNE_LATENCY_WINDOW];
+  // Bins of the latencies of the window, in a ring
+  int nvalues;
+  // Number of latencies in the window
+  int next;
+  // Position of the next latency in the ring
+} btune_latency_hist;
+
+// Forget all the latencies
+void btune_latency_reset(btune_latency_hist *hist);
+
+// Add a latency (in seconds), forgetting the oldest one when the window is full
+void btune_latency_add(btune_latency_hist *hist, double secs);
+
+// The `q` quantile (between 0 and 1) of the latencies of the window (0 if empty)
+double btune_latency_quantile(const btune_latency_hist *hist, double q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_LATENCY_H */
@@ -16,9 +16,11 @@
 
 #include <blosc2.h>
 #include <stdio.h>
+#include <string.h>
 #include "context.h"
 #include "entropy_probe.h"
-#include "btune.h"
+#include "btune_types.h"
+#include "btune_calibrate.h"
 #include "btune_model.h"
 #include "json.h"
 
@@ -44,13 +46,14 @@ typedef struct {
 } metadata_t;
 
 
+// Number of words sampled for the fingerprint of a chunk submitted in advance
+#define FINGERPRINT_NWORDS 256
+
 model_t g_models[256];
 int nmodels_dir = 0;
 
 bool BTUNE_REUSE_MODELS = false;
 
-float zeros_speed = -1.;
-
 
 static int fsize(FILE *file) {
   fseek(file, 0, SEEK_END);
@@ -107,8 +110,18 @@ static float normalize(float value, float mean, float std) {
 }
 
 
+// The speed of compressing a zeros chunk is the machine relative speed measure
+static float machine_zeros_speed(btune_struct *btune, size_t size) {
+  const btune_calibration *calibration = btune_calibration_get(btune->config.cache_dir);
+  if (calibration == NULL) {
+    return -1;
+  }
+  return btune_calibration_zeros_speed(calibration, (int32_t) size);
+}
+
 static int get_best_codec_for_chunk(
-  blosc2_context *src_ctx,
+  btune_struct *btune,
+  int32_t blocksize,
   const void *src,
   size_t size,
   tflite::Interpreter *interpreter,
@@ -124,54 +137,16 @@ static int get_best_codec_for_chunk(
     return -1;
   }
 
-  btune_struct *btune = (btune_struct *)src_ctx->tuner_params;
-  // <<< ENTROPY PROBER START
-  // cparams
-  blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
-  cparams.compcode = ENTROPY_PROBE_ID;
-  cparams.instr_codec = true;  // instrumented (cratio/cspeed)
-  cparams.typesize = src_ctx->typesize;
-  cparams.blocksize = src_ctx->blocksize;
-  cparams.splitmode = BLOSC_NEVER_SPLIT;
-  cparams.nthreads = 4;
-  cparams.filters[BLOSC2_MAX_FILTERS - 1] = BLOSC_NOFILTER;
-  blosc2_context *cctx = blosc2_create_cctx(cparams);
-
-  // dparams
-  blosc2_dparams dparams = BLOSC2_DPARAMS_DEFAULTS;
-  blosc2_context *dctx = blosc2_create_dctx(dparams);
-  if (zeros_speed < 0.) {
-    // Compress zeros chunk to get a machine relative speed measure
-    zeros_speed = get_zeros_speed(size);
-    if (zeros_speed < 0.) {
-        fprintf(stderr, "Error %d computing zeros speed\n", (int)zeros_speed);
-        return zeros_speed;
-    }
+  float zeros_speed = machine_zeros_speed(btune, size);
+  if (zeros_speed <= 0) {
+    return -1;
   }
 
-  // Compress chunk, this will output the instrumentation data
-  // `compressed_size` should be
-  // BLOSC2_MAX_OVERHEAD + sizeof(blosc2_instr) * nblocks + sizeof(int32_t) * nblocks + sizeof(int32_t)
-  // but we won't always know nblocks before compression
-  int compressed_size = BLOSC2_MAX_OVERHEAD + size;
-  uint8_t *cdata = (uint8_t *) malloc(compressed_size);
-  int csize = blosc2_compress_ctx(cctx, src, size, cdata, compressed_size);
-  if (csize < 0) {
-    free(cdata);
-    fprintf(stderr, "Error %d compressing chunk\n", csize);
-    return csize;
-  }
-  if (csize == 0) {
-    csize = compressed_size;
-  }
-  // Decompress so we can read the instrumentation data
-  int decomp_size = cctx->nblocks * sizeof(blosc2_instr);
-  uint8_t *ddata = (uint8_t *) malloc(decomp_size);
-  int dsize = blosc2_decompress_ctx(dctx, cdata, csize, ddata, decomp_size);
-  blosc2_free_ctx(cctx);
-  blosc2_free_ctx(dctx);
-  free(cdata);
-  BLOSC_ERROR(dsize);
+  // <<< ENTROPY PROBER START
+  entropy_probe_block *blocks;
+  int nblocks = btune_probe_run(&btune->probe, src, (int32_t) size, blocksize,
+                                btune->config.probe_budget, &blocks);
+  BLOSC_ERROR(nblocks);
   // >>> ENTROPY PROBER END
   if (trace) {
     blosc_set_timestamp(&t1);
@@ -185,21 +160,16 @@ static int get_best_codec_for_chunk(
 
 
   // Read the cratio/cspeed for every block and compute mean
-  int nblocks = dsize / (int)sizeof(blosc2_instr);
-  blosc2_instr *instr_data = (blosc2_instr *)ddata;
 
   float cratio = 0;
+  float cratio_var = 0;
   float rel_speed = 0;
-  bool special_val = false;
   for (int i = 0; i < nblocks; i++) {
-    special_val = instr_data->flags[0];
-    if (!special_val) {
-      cratio += instr_data->cratio;
-      float ctime = 1.f / instr_data->cspeed;
-      float ftime = 1.f / instr_data->filter_speed;
-      rel_speed += 1.f / (ctime + ftime) / zeros_speed;
+    if (!blocks[i].special) {
+      cratio += blocks[i].cratio;
+      cratio_var += blocks[i].cratio_var;
+      rel_speed += blocks[i].cspeed / zeros_speed;
     }
-    instr_data++;
   }
   cratio /= nblocks;
   rel_speed /= nblocks;
@@ -210,16 +180,19 @@ static int get_best_codec_for_chunk(
   int best = get_best_codec(interpreter, cratio_norm, cspeed_norm,
                             btune->config.tradeoff[0] + btune->config.tradeoff[2] / 2,
                             metadata->ncategories);
-  free(ddata);
   // >>> INFERENCE END
   if (trace) {
     blosc_set_timestamp(&t2);
     category_t cat = metadata->categories[best];
+    btune_probe *probe = &btune->probe;
     BTUNE_TRACE(
-      "Inference category=%d codec=%d filter=%d clevel=%d splitmode=%d time entropy=%f inference=%f",
+      "Inference category=%d codec=%d filter=%d clevel=%d splitmode=%d time entropy=%f inference=%f"
+      " probe=%.1f MB/s (total=%f s) cratio=%f var=%f",
       best, cat.codec, cat.filter, cat.clevel, cat.splitmode,
       (float) blosc_elapsed_secs(t0, t1),
-      (float) blosc_elapsed_secs(t1, t2)
+      (float) blosc_elapsed_secs(t1, t2),
+      (double) size / probe->last_time / 1e6, probe->total_time,
+      cratio, cratio_var / nblocks
     );
   }
 
@@ -460,6 +433,21 @@ void btune_model_init(blosc2_context * ctx) {
   }
 }
 
+// A cheap fingerprint of the contents of a chunk, out of evenly spaced words
+static uint64_t chunk_fingerprint(const void *src, int32_t size) {
+  const uint8_t *bytes = (const uint8_t *) src;
+  uint64_t hash = 14695981039346656037ULL ^ (uint64_t) size;
+  int32_t nwords = size / (int32_t) sizeof(uint64_t);
+  int32_t nsamples = (nwords < FINGERPRINT_NWORDS) ? nwords : FINGERPRINT_NWORDS;
+  for (int32_t i = 0; i < nsamples; i++) {
+    uint64_t word;
+    int64_t offset = (int64_t) i * nwords / nsamples * sizeof(uint64_t);
+    memcpy(&word, bytes + offset, sizeof(word));
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  return hash;
+}
+
 int btune_model_inference(
     blosc2_context * ctx,
     int * compcode, uint8_t * filter, int * clevel, int32_t * splitmode
@@ -476,7 +464,44 @@ int btune_model_inference(
 
   const void *src = (const void*)ctx->src;
   int32_t size = ctx->srcsize;
-  int best = get_best_codec_for_chunk(ctx, src, size, interpreter, metadata);
+  int best = -1;
+  bool found = false;
+  if (btune_params->lookahead_job != NULL) {
+    bool pending = false;
+    uint64_t fingerprint = chunk_fingerprint(src, size);
+    // The last submitted entry may still be in use by the helper thread, so the finished
+    // ones are searched first and it is waited for only if none of them matches
+    int last = (btune_params->lookahead_next + BTUNE_LOOKAHEAD_DEPTH - 1) % BTUNE_LOOKAHEAD_DEPTH;
+    for (int n = 1; n <= BTUNE_LOOKAHEAD_DEPTH && !found; n++) {
+      int i = (last + n) % BTUNE_LOOKAHEAD_DEPTH;
+      btune_lookahead_entry *entry = &btune_params->lookahead[i];
+      if (entry->src == NULL) {
+        continue;
+      }
+      pending = true;
+      if (entry->src == src && entry->size == size && entry->fingerprint == fingerprint) {
+        if (i == last) {
+          btune_job_wait(btune_params->lookahead_job);
+        }
+        best = entry->category;
+        entry->src = NULL;
+        found = true;
+      }
+    }
+    if (pending && !found) {
+      // The chunks are not compressed in the order they were submitted, so the
+      // rest of the entries cannot be trusted either
+      btune_model_lookahead_clear(btune_params);
+    }
+  }
+  if (!found) {
+    if (btune_params->lookahead_job != NULL) {
+      // The interpreter cannot be used while a chunk submitted in advance is being inferred
+      btune_job_wait(btune_params->lookahead_job);
+    }
+    best = get_best_codec_for_chunk(btune_params, ctx->blocksize, src, size,
+                                    interpreter, metadata);
+  }
   if (best < 0) {
     return best;
   }
@@ -519,6 +544,78 @@ int most_predicted(btune_struct *btune_params, int *compcode,
   return 0;
 }
 
+int btune_model_get_counts(btune_struct *btune_params, unsigned long *counts, int size) {
+  metadata_t *meta = (metadata_t *) btune_params->metadata;
+  if (meta == NULL) {
+    return 0;
+  }
+  for (int i = 0; i < meta->ncategories && i < size; ++i) {
+    counts[i] = meta->categories[i].count;
+  }
+  return meta->ncategories;
+}
+
+void btune_model_set_counts(btune_struct *btune_params, const unsigned long *counts, int size) {
+  metadata_t *meta = (metadata_t *) btune_params->metadata;
+  if (meta == NULL) {
+    return;
+  }
+  for (int i = 0; i < meta->ncategories && i < size; ++i) {
+    meta->categories[i].count = counts[i];
+  }
+}
+
+static void lookahead_main(void *arg) {
+  btune_lookahead_entry *entry = (btune_lookahead_entry *) arg;
+  btune_struct *btune_params = (btune_struct *) entry->btune;
+  entry->category = get_best_codec_for_chunk(btune_params, entry->blocksize,
+                                             entry->src, entry->size,
+                                             (tflite::Interpreter *) btune_params->interpreter,
+                                             (metadata_t *) btune_params->metadata);
+}
+
+int btune_model_lookahead(blosc2_context * ctx, const void * src, int32_t size) {
+  btune_struct *btune_params = (btune_struct*) ctx->tuner_params;
+  if (btune_params->interpreter == NULL || btune_params->metadata == NULL ||
+      btune_params->inference_count == 0 || size < BLOSC_MIN_BUFFERSIZE) {
+    return -1;
+  }
+  // Done here, so that the helper thread does not compete with the compression for it
+  if (machine_zeros_speed(btune_params, size) <= 0) {
+    return -1;
+  }
+  if (btune_params->lookahead_job == NULL) {
+    btune_params->lookahead_job = btune_job_new();
+    if (btune_params->lookahead_job == NULL) {
+      return -1;
+    }
+  }
+
+  // Reuse the oldest entry, once it is not in use by the helper thread
+  btune_job_wait(btune_params->lookahead_job);
+  btune_lookahead_entry *entry = &btune_params->lookahead[btune_params->lookahead_next];
+  btune_params->lookahead_next = (btune_params->lookahead_next + 1) % BTUNE_LOOKAHEAD_DEPTH;
+  entry->src = src;
+  entry->size = size;
+  entry->fingerprint = chunk_fingerprint(src, size);
+  entry->blocksize = ctx->blocksize;
+  entry->category = -1;
+  entry->btune = btune_params;
+  btune_job_submit(btune_params->lookahead_job, lookahead_main, entry);
+
+  return 0;
+}
+
+void btune_model_lookahead_clear(btune_struct *btune_params) {
+  if (btune_params->lookahead_job == NULL) {
+    return;
+  }
+  btune_job_wait(btune_params->lookahead_job);
+  for (int i = 0; i < BTUNE_LOOKAHEAD_DEPTH; i++) {
+    btune_params->lookahead[i].src = NULL;
+  }
+}
+
 void btune_model_free(blosc2_context * ctx) {
   btune_struct *btune_params = (btune_struct *) ctx->tuner_params;
 
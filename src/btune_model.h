@@ -25,11 +25,24 @@ int btune_model_inference(
   blosc2_context * ctx,
   int * compcode, uint8_t * filter, int * clevel, int32_t * splitmode);
 
+// Submit a chunk to be probed and inferred in the background.  Returns 0 if
+// submitted, and a negative value when no inference is needed or possible.
+int btune_model_lookahead(blosc2_context * ctx, const void * src, int32_t size);
+
+// Forget the chunks submitted in advance, e.g. when no more inferences are going to be made
+void btune_model_lookahead_clear(btune_struct *btune_params);
+
 void btune_model_free(blosc2_context * ctx);
 
 int most_predicted(btune_struct *btune_params, int *compcode,
                    uint8_t *filter, int *clevel, int32_t *splitmode);
 
+// Copy up to `size` category counts into `counts`, returning the number of categories
+int btune_model_get_counts(btune_struct *btune_params, unsigned long *counts, int size);
+
+// Set the counts of the first `size` categories
+void btune_model_set_counts(btune_struct *btune_params, const unsigned long *counts, int size);
+
 void g_models_free(void);
 
 void set_reuse_models(bool new_value);
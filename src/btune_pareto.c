@@ -0,0 +1,101 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "btune_pareto.h"
+
+
+static bool same_cparams(const cparams_btune *a, const cparams_btune *b) {
+  return a->compcode == b->compcode && a->compcode_meta == b->compcode_meta &&
+         memcmp(&a->pipeline, &b->pipeline, sizeof(btune_pipeline)) == 0 &&
+         a->splitmode == b->splitmode && a->clevel == b->clevel &&
+         a->blocksize == b->blocksize && a->nthreads_comp == b->nthreads_comp &&
+         a->nthreads_decomp == b->nthreads_decomp;
+}
+
+// Whether `a` is at least as good as `b` in everything and better in something.
+// A dtime of 0 means that it was not measured, and then it is not compared.
+static bool dominates(const cparams_btune *a, const cparams_btune *b) {
+  bool dtimes = a->dtime > 0 && b->dtime > 0;
+  if (a->cratio < b->cratio || a->ctime > b->ctime || (dtimes && a->dtime > b->dtime)) {
+    return false;
+  }
+  return a->cratio > b->cratio || a->ctime < b->ctime || (dtimes && a->dtime < b->dtime);
+}
+
+static void remove_point(btune_pareto *front, int i) {
+  front->npoints--;
+  front->points[i] = front->points[front->npoints];
+}
+
+// Squared distance in log space, so that all the measurements weigh the same
+static double distance(const cparams_btune *a, const cparams_btune *b) {
+  double dr = log(a->cratio / b->cratio);
+  double dc = log(a->ctime / b->ctime);
+  double dd = (a->dtime > 0 && b->dtime > 0) ? log(a->dtime / b->dtime) : 0;
+  return dr * dr + dc * dc + dd * dd;
+}
+
+// Index of the point closest to another one, i.e. the one whose loss matters the least
+static int most_crowded(btune_pareto *front) {
+  int crowded = 0;
+  double min_distance = DBL_MAX;
+  for (int i = 0; i < front->npoints; i++) {
+    for (int j = i + 1; j < front->npoints; j++) {
+      double d = distance(&front->points[i], &front->points[j]);
+      if (d < min_distance) {
+        min_distance = d;
+        crowded = i;
+      }
+    }
+  }
+  return crowded;
+}
+
+
+void btune_pareto_reset(btune_pareto *front) {
+  front->npoints = 0;
+}
+
+bool btune_pareto_add(btune_pareto *front, const cparams_btune *cparams) {
+  if (!(cparams->cratio > 0) || !(cparams->ctime > 0)) {
+    return false;
+  }
+
+  // The newest measurements of some cparams replace the older ones
+  for (int i = 0; i < front->npoints; i++) {
+    if (same_cparams(&front->points[i], cparams)) {
+      remove_point(front, i);
+      break;
+    }
+  }
+
+  for (int i = 0; i < front->npoints; i++) {
+    if (dominates(&front->points[i], cparams)) {
+      return false;
+    }
+  }
+  for (int i = front->npoints - 1; i >= 0; i--) {
+    if (dominates(cparams, &front->points[i])) {
+      remove_point(front, i);
+    }
+  }
+
+  if (front->npoints == BTUNE_PARETO_SIZE) {
+    remove_point(front, most_crowded(front));
+  }
+  front->points[front->npoints++] = *cparams;
+
+  return true;
+}
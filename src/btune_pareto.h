@@ -0,0 +1,41 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_pareto.h
+ * @brief Pareto front of the measured cparams.
+ *
+ * Keeps the cparams that are not beaten at the same time in cratio, ctime and
+ * dtime by any other one, so that a change in the tradeoff or in the performance
+ * mode can pick a new best without exploring again.
+ */
+
+#ifndef BTUNE_PARETO_H
+#define BTUNE_PARETO_H
+
+#include <stdbool.h>
+#include "btune-private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Empty the front, e.g. after a change in the data
+void btune_pareto_reset(btune_pareto *front);
+
+// Add the measurements of `cparams` (replacing older ones of the same cparams) and
+// drop the points it dominates.  Returns whether `cparams` is in the front.
+bool btune_pareto_add(btune_pareto *front, const cparams_btune *cparams);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_PARETO_H */
@@ -0,0 +1,386 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btune_persist.h"
+#include "btune_model.h"
+#include "json.h"
+
+// Version of the serialized state
+#define PERSIST_VERSION 1
+
+
+// A growing text buffer
+typedef struct {
+  char *data;
+  int32_t len;
+  int32_t cap;
+} text_buffer;
+
+static void append(text_buffer *buf, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+  if (n < 0 || buf->data == NULL) {
+    return;
+  }
+  if (buf->len + n + 1 > buf->cap) {
+    int32_t cap = 2 * buf->cap + n + 1;
+    char *data = realloc(buf->data, cap);
+    if (data == NULL) {
+      free(buf->data);
+      buf->data = NULL;
+      return;
+    }
+    buf->data = data;
+    buf->cap = cap;
+  }
+  va_start(args, fmt);
+  vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+  va_end(args);
+  buf->len += n;
+}
+
+static void append_array(text_buffer *buf, const char *name, const uint8_t *array, int size) {
+  append(buf, "\"%s\": [", name);
+  for (int i = 0; i < size; i++) {
+    append(buf, (i == 0) ? "%d" : ", %d", array[i]);
+  }
+  append(buf, "], ");
+}
+
+static void append_cparams(text_buffer *buf, const cparams_btune *cparams) {
+  append(buf, "{\"compcode\": %d, \"compcode_meta\": %d, \"filter\": %d, \"filter_meta\": %d, ",
+         cparams->compcode, cparams->compcode_meta, cparams->filter, cparams->filter_meta);
+  append_array(buf, "filters", cparams->pipeline.filters, BLOSC2_MAX_FILTERS);
+  append_array(buf, "filters_meta", cparams->pipeline.filters_meta, BLOSC2_MAX_FILTERS);
+  append(buf, "\"splitmode\": %d, \"clevel\": %d, \"blocksize\": %d, ",
+         cparams->splitmode, cparams->clevel, cparams->blocksize);
+  append(buf, "\"nthreads_comp\": %d, \"nthreads_decomp\": %d, ",
+         cparams->nthreads_comp, cparams->nthreads_decomp);
+  append(buf, "\"increasing_clevel\": %d, \"increasing_block\": %d, \"increasing_nthreads\": %d, ",
+         cparams->increasing_clevel, cparams->increasing_block, cparams->increasing_nthreads);
+  append(buf, "\"score\": %.17g, \"cratio\": %.17g, \"ctime\": %.17g, \"dtime\": %.17g}",
+         cparams->score, cparams->cratio, cparams->ctime, cparams->dtime);
+}
+
+int btune_persist_save(blosc2_context *cctx) {
+  btune_struct *btune_params = (btune_struct *) cctx->tuner_params;
+  blosc2_schunk *schunk = cctx->schunk;
+  if (schunk == NULL) {
+    return -1;
+  }
+
+  text_buffer buf = {malloc(1024), 0, 1024};
+  append(&buf, "{\"version\": %d, ", PERSIST_VERSION);
+  append(&buf, "\"steps_count\": %d, \"state\": %d, \"readapt_from\": %d, \"is_repeating\": %d, ",
+         btune_params->steps_count, btune_params->state, btune_params->readapt_from,
+         btune_params->is_repeating);
+  append(&buf, "\"nwaitings\": %d, \"nsofts\": %d, \"nhards\": %d, ",
+         btune_params->nwaitings, btune_params->nsofts, btune_params->nhards);
+  append(&buf, "\"nhards_before_stop\": %u, \"cparams_hint\": %d, ",
+         btune_params->config.behaviour.nhards_before_stop, btune_params->config.cparams_hint);
+  append(&buf, "\"inference_count\": %d, \"inference_ended\": %d, ",
+         btune_params->inference_count, btune_params->inference_ended);
+  append(&buf, "\"best\": ");
+  append_cparams(&buf, btune_params->best);
+  append(&buf, ", \"pareto\": [");
+  for (int i = 0; i < btune_params->pareto.npoints; i++) {
+    if (i > 0) {
+      append(&buf, ", ");
+    }
+    append_cparams(&buf, &btune_params->pareto.points[i]);
+  }
+  append(&buf, "], \"categories\": [");
+  int ncategories = btune_model_get_counts(btune_params, NULL, 0);
+  if (ncategories > 0) {
+    // Without the counts the model just starts afresh when the frame is reopened
+    unsigned long *counts = malloc(ncategories * sizeof(unsigned long));
+    if (counts != NULL) {
+      btune_model_get_counts(btune_params, counts, ncategories);
+      for (int i = 0; i < ncategories; i++) {
+        append(&buf, (i == 0) ? "%lu" : ", %lu", counts[i]);
+      }
+      free(counts);
+    }
+  }
+  append(&buf, "]}");
+  if (buf.data == NULL) {
+    return -1;
+  }
+
+  int rc;
+  if (blosc2_vlmeta_exists(schunk, BTUNE_VLMETA_NAME) >= 0) {
+    rc = blosc2_vlmeta_update(schunk, BTUNE_VLMETA_NAME, (uint8_t *) buf.data, buf.len + 1, NULL);
+  } else {
+    rc = blosc2_vlmeta_add(schunk, BTUNE_VLMETA_NAME, (uint8_t *) buf.data, buf.len + 1, NULL);
+  }
+  free(buf.data);
+  return (rc < 0) ? rc : 0;
+}
+
+
+// Numbers written with %.17g may be parsed as integers
+static double read_number(json_value *value) {
+  return (value->type == json_integer) ? (double) value->u.integer : value->u.dbl;
+}
+
+static bool is_number(json_value *value) {
+  return value->type == json_integer || value->type == json_double;
+}
+
+static int read_array(json_value *value, uint8_t *array, int size) {
+  if (value->type != json_array || (int) value->u.array.length != size) {
+    return -1;
+  }
+  for (int i = 0; i < size; i++) {
+    if (value->u.array.values[i]->type != json_integer) {
+      return -1;
+    }
+    array[i] = (uint8_t) value->u.array.values[i]->u.integer;
+  }
+  return 0;
+}
+
+static int read_cparams(json_value *json, cparams_btune *cparams) {
+  if (json->type != json_object) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < json->u.object.length; i++) {
+    const char *name = json->u.object.values[i].name;
+    json_value *value = json->u.object.values[i].value;
+    if (strcmp(name, "filters") == 0) {
+      if (read_array(value, cparams->pipeline.filters, BLOSC2_MAX_FILTERS) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (strcmp(name, "filters_meta") == 0) {
+      if (read_array(value, cparams->pipeline.filters_meta, BLOSC2_MAX_FILTERS) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (!is_number(value)) {
+      return -1;
+    }
+    double number = read_number(value);
+    if (strcmp(name, "compcode") == 0) {
+      cparams->compcode = (int) number;
+    }
+    else if (strcmp(name, "compcode_meta") == 0) {
+      cparams->compcode_meta = (uint8_t) number;
+    }
+    else if (strcmp(name, "filter") == 0) {
+      cparams->filter = (uint8_t) number;
+    }
+    else if (strcmp(name, "filter_meta") == 0) {
+      cparams->filter_meta = (uint8_t) number;
+    }
+    else if (strcmp(name, "splitmode") == 0) {
+      cparams->splitmode = (int32_t) number;
+    }
+    else if (strcmp(name, "clevel") == 0) {
+      cparams->clevel = (int) number;
+    }
+    else if (strcmp(name, "blocksize") == 0) {
+      cparams->blocksize = (int32_t) number;
+    }
+    else if (strcmp(name, "nthreads_comp") == 0) {
+      cparams->nthreads_comp = (int) number;
+    }
+    else if (strcmp(name, "nthreads_decomp") == 0) {
+      cparams->nthreads_decomp = (int) number;
+    }
+    else if (strcmp(name, "increasing_clevel") == 0) {
+      cparams->increasing_clevel = number != 0;
+    }
+    else if (strcmp(name, "increasing_block") == 0) {
+      cparams->increasing_block = number != 0;
+    }
+    else if (strcmp(name, "increasing_nthreads") == 0) {
+      cparams->increasing_nthreads = number != 0;
+    }
+    else if (strcmp(name, "score") == 0) {
+      cparams->score = number;
+    }
+    else if (strcmp(name, "cratio") == 0) {
+      cparams->cratio = number;
+    }
+    else if (strcmp(name, "ctime") == 0) {
+      cparams->ctime = number;
+    }
+    else if (strcmp(name, "dtime") == 0) {
+      cparams->dtime = number;
+    }
+  }
+  return 0;
+}
+
+// Parse the whole state before touching btune_params, so that a corrupted entry changes nothing
+static int read_state(json_value *json, btune_struct *restored, unsigned long **counts,
+                      int *ncounts) {
+  int version = 0;
+  bool has_best = false;
+  for (unsigned int i = 0; i < json->u.object.length; i++) {
+    const char *name = json->u.object.values[i].name;
+    json_value *value = json->u.object.values[i].value;
+    if (strcmp(name, "best") == 0) {
+      if (read_cparams(value, restored->best) < 0) {
+        return -1;
+      }
+      has_best = true;
+    }
+    else if (strcmp(name, "pareto") == 0) {
+      if (value->type != json_array) {
+        return -1;
+      }
+      restored->pareto.npoints = 0;
+      for (unsigned int j = 0; j < value->u.array.length && j < BTUNE_PARETO_SIZE; j++) {
+        cparams_btune *point = &restored->pareto.points[restored->pareto.npoints];
+        *point = *restored->best;
+        if (read_cparams(value->u.array.values[j], point) < 0) {
+          return -1;
+        }
+        restored->pareto.npoints++;
+      }
+    }
+    else if (strcmp(name, "categories") == 0) {
+      if (value->type != json_array) {
+        return -1;
+      }
+      free(*counts);
+      *ncounts = (int) value->u.array.length;
+      *counts = malloc((*ncounts + 1) * sizeof(unsigned long));
+      if (*counts == NULL) {
+        return -1;
+      }
+      for (int j = 0; j < *ncounts; j++) {
+        json_value *count = value->u.array.values[j];
+        if (count->type != json_integer || count->u.integer < 0) {
+          return -1;
+        }
+        (*counts)[j] = (unsigned long) count->u.integer;
+      }
+    }
+    // The rest of the fields are integers, a double would be misread through u.integer
+    else if (value->type != json_integer) {
+      return -1;
+    }
+    else if (strcmp(name, "version") == 0) {
+      version = (int) value->u.integer;
+    }
+    else if (strcmp(name, "steps_count") == 0) {
+      restored->steps_count = (int) value->u.integer;
+    }
+    else if (strcmp(name, "state") == 0) {
+      if (value->u.integer < CODEC_FILTER || value->u.integer > STOP) {
+        return -1;
+      }
+      restored->state = (btune_state) value->u.integer;
+    }
+    else if (strcmp(name, "readapt_from") == 0) {
+      if (value->u.integer < WAIT || value->u.integer > HARD) {
+        return -1;
+      }
+      restored->readapt_from = (readapt_type) value->u.integer;
+    }
+    else if (strcmp(name, "is_repeating") == 0) {
+      restored->is_repeating = value->u.integer != 0;
+    }
+    else if (strcmp(name, "nwaitings") == 0) {
+      restored->nwaitings = (int) value->u.integer;
+    }
+    else if (strcmp(name, "nsofts") == 0) {
+      restored->nsofts = (int) value->u.integer;
+    }
+    else if (strcmp(name, "nhards") == 0) {
+      restored->nhards = (int) value->u.integer;
+    }
+    else if (strcmp(name, "nhards_before_stop") == 0) {
+      restored->config.behaviour.nhards_before_stop = (uint32_t) value->u.integer;
+    }
+    else if (strcmp(name, "cparams_hint") == 0) {
+      restored->config.cparams_hint = value->u.integer != 0;
+    }
+    else if (strcmp(name, "inference_count") == 0) {
+      restored->inference_count = (int) value->u.integer;
+    }
+    else if (strcmp(name, "inference_ended") == 0) {
+      restored->inference_ended = value->u.integer != 0;
+    }
+  }
+  if (version != PERSIST_VERSION || !has_best) {
+    return -1;
+  }
+  // A stale or foreign entry must not hand invalid cparams to blosc2
+  if (!btune_valid_cparams(restored, restored->best)) {
+    return -1;
+  }
+  for (int i = 0; i < restored->pareto.npoints; i++) {
+    if (!btune_valid_cparams(restored, &restored->pareto.points[i])) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int btune_persist_load(blosc2_context *cctx) {
+  btune_struct *btune_params = (btune_struct *) cctx->tuner_params;
+  blosc2_schunk *schunk = cctx->schunk;
+  if (schunk == NULL || blosc2_vlmeta_exists(schunk, BTUNE_VLMETA_NAME) < 0) {
+    return -1;
+  }
+  uint8_t *content;
+  int32_t content_len;
+  if (blosc2_vlmeta_get(schunk, BTUNE_VLMETA_NAME, &content, &content_len) < 0) {
+    return -1;
+  }
+  json_value *json = json_parse((const json_char *) content, strnlen((char *) content, content_len));
+  free(content);
+  if (json == NULL) {
+    return -1;
+  }
+
+  btune_struct restored = *btune_params;
+  cparams_btune best = *btune_params->best;
+  restored.best = &best;
+  unsigned long *counts = NULL;
+  int ncounts = 0;
+  int rc = (json->type == json_object) ? read_state(json, &restored, &counts, &ncounts) : -1;
+  json_value_free(json);
+
+  if (rc == 0) {
+    *btune_params->best = best;
+    btune_params->pareto = restored.pareto;
+    btune_params->steps_count = restored.steps_count;
+    btune_params->state = restored.state;
+    btune_params->readapt_from = restored.readapt_from;
+    btune_params->is_repeating = restored.is_repeating;
+    btune_params->nwaitings = restored.nwaitings;
+    btune_params->nsofts = restored.nsofts;
+    btune_params->nhards = restored.nhards;
+    btune_params->config.behaviour.nhards_before_stop = restored.config.behaviour.nhards_before_stop;
+    btune_params->config.cparams_hint = restored.config.cparams_hint;
+    btune_params->inference_count = restored.inference_count;
+    btune_params->inference_ended = restored.inference_ended;
+    if (counts != NULL) {
+      btune_model_set_counts(btune_params, counts, ncounts);
+    }
+  }
+  free(counts);
+  return rc;
+}
@@ -0,0 +1,43 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_persist.h
+ * @brief Persistence of the tuner state in the vlmeta of the super-chunk.
+ *
+ * The best cparams, the Pareto front, the readapt counters and the counts of
+ * the model categories are stored as JSON in the "btune" vlmeta entry, so that
+ * appending to a reopened frame goes on from where the last session stopped.
+ */
+
+#ifndef BTUNE_PERSIST_H
+#define BTUNE_PERSIST_H
+
+#include "btune-private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Name of the vlmeta entry with the tuner state
+#define BTUNE_VLMETA_NAME "btune"
+
+// Store the tuner state of `cctx` in the vlmeta of its super-chunk.  Returns 0 on success.
+int btune_persist_save(blosc2_context *cctx);
+
+// Restore the tuner state of `cctx` from the vlmeta of its super-chunk.
+// Returns 0 if the state was restored, and a negative value otherwise.
+int btune_persist_load(blosc2_context *cctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_PERSIST_H */
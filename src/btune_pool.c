@@ -0,0 +1,168 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if defined(_WIN32) && !defined(__GNUC__)
+  #include "win32/pthread.h"
+#else
+  #include <pthread.h>
+#endif
+
+#include "btune_pool.h"
+
+
+struct btune_pool_s {
+  int nworkers;
+  // Number of workers (including the caller thread)
+  pthread_t *threads;
+  // The spawned threads (nworkers - 1)
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cv;
+  // Signals a new round of tasks (or the end of the pool)
+  pthread_cond_t done_cv;
+  // Signals that the spawned threads have finished the current round
+  btune_task_fn fn;
+  void *arg;
+  int ntasks;
+  int next_task;
+  // Next task to be claimed in the current round
+  int nbusy;
+  // Spawned threads still working in the current round
+  unsigned round;
+  // Round counter, used for waking up the spawned threads
+  bool end;
+};
+
+typedef struct {
+  btune_pool *pool;
+  int worker;
+} worker_arg;
+
+
+// Claim and run tasks until there are no more left in the current round.
+// Must be called with the mutex locked, returns with the mutex locked.
+static void run_tasks(btune_pool *pool, int worker) {
+  while (pool->next_task < pool->ntasks) {
+    int index = pool->next_task++;
+    pthread_mutex_unlock(&pool->mutex);
+    pool->fn(pool->arg, index, worker);
+    pthread_mutex_lock(&pool->mutex);
+  }
+}
+
+static void *worker_main(void *arg) {
+  worker_arg *warg = (worker_arg *) arg;
+  btune_pool *pool = warg->pool;
+  int worker = warg->worker;
+  free(warg);
+
+  unsigned seen = 0;
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (!pool->end && pool->round == seen) {
+      pthread_cond_wait(&pool->work_cv, &pool->mutex);
+    }
+    if (pool->end) {
+      break;
+    }
+    seen = pool->round;
+    run_tasks(pool, worker);
+    pool->nbusy--;
+    if (pool->nbusy == 0) {
+      pthread_cond_signal(&pool->done_cv);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+btune_pool *btune_pool_new(int nworkers) {
+  if (nworkers < 1) {
+    nworkers = 1;
+  }
+  btune_pool *pool = calloc(1, sizeof(btune_pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->nworkers = nworkers;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->work_cv, NULL);
+  pthread_cond_init(&pool->done_cv, NULL);
+
+  pool->threads = malloc(nworkers * sizeof(pthread_t));
+  if (pool->threads == NULL) {
+    pool->nworkers = 1;
+    btune_pool_free(pool);
+    return NULL;
+  }
+  for (int i = 1; i < nworkers; i++) {
+    worker_arg *warg = malloc(sizeof(worker_arg));
+    if (warg == NULL) {
+      // Stop the workers already started
+      pool->nworkers = i;
+      btune_pool_free(pool);
+      return NULL;
+    }
+    warg->pool = pool;
+    warg->worker = i;
+    if (pthread_create(&pool->threads[i - 1], NULL, worker_main, warg) != 0) {
+      // Go on with the threads that could be created
+      free(warg);
+      pool->nworkers = i;
+      break;
+    }
+  }
+
+  return pool;
+}
+
+int btune_pool_nworkers(btune_pool *pool) {
+  return pool->nworkers;
+}
+
+void btune_pool_run(btune_pool *pool, btune_task_fn fn, void *arg, int ntasks) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->ntasks = ntasks;
+  pool->next_task = 0;
+  pool->nbusy = pool->nworkers - 1;
+  pool->round++;
+  pthread_cond_broadcast(&pool->work_cv);
+
+  // The caller works too
+  run_tasks(pool, 0);
+  while (pool->nbusy > 0) {
+    pthread_cond_wait(&pool->done_cv, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void btune_pool_free(btune_pool *pool) {
+  if (pool == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->mutex);
+  pool->end = true;
+  pthread_cond_broadcast(&pool->work_cv);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 1; i < pool->nworkers; i++) {
+    pthread_join(pool->threads[i - 1], NULL);
+  }
+  free(pool->threads);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->work_cv);
+  pthread_cond_destroy(&pool->done_cv);
+  free(pool);
+}
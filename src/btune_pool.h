@@ -0,0 +1,48 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_pool.h
+ * @brief Btune worker pool.
+ *
+ * A tiny pool of persistent threads for running parallel-for loops
+ * (e.g. evaluating several candidate cparams over the same chunk).
+ */
+
+#ifndef BTUNE_POOL_H
+#define BTUNE_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Task to be run for every index in [0, ntasks).  `worker` is in [0, nworkers)
+// and can be used for indexing per-worker scratch buffers.
+typedef void (*btune_task_fn)(void *arg, int index, int worker);
+
+typedef struct btune_pool_s btune_pool;
+
+// Create a pool with `nworkers` workers (the caller thread counts as one of them).
+// Returns NULL if it could not be allocated.
+btune_pool *btune_pool_new(int nworkers);
+
+// Number of workers in the pool
+int btune_pool_nworkers(btune_pool *pool);
+
+// Run `fn` for every task index and wait until all of them have finished
+void btune_pool_run(btune_pool *pool, btune_task_fn fn, void *arg, int ntasks);
+
+void btune_pool_free(btune_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_POOL_H */
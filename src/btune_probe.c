@@ -0,0 +1,63 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdlib.h>
+
+#include "btune_probe.h"
+
+// Number of threads probing the blocks (the caller included)
+#define PROBE_NTHREADS 4
+// Blocksize when the context does not have one yet
+#define PROBE_DEFAULT_BLOCKSIZE (256 * 1024)
+
+
+int btune_probe_run(btune_probe *probe, const void *src, int32_t size, int32_t blocksize,
+                    int32_t budget, entropy_probe_block **blocks) {
+  blosc_timestamp_t t0, t1;
+  blosc_set_timestamp(&t0);
+
+  if (blocksize <= 0) {
+    blocksize = PROBE_DEFAULT_BLOCKSIZE;
+  }
+  if (blocksize > size) {
+    blocksize = size;
+  }
+  if (probe->pool == NULL) {
+    probe->pool = btune_pool_new(PROBE_NTHREADS);
+    BLOSC_ERROR_NULL(probe->pool, BLOSC2_ERROR_THREAD_CREATE);
+  }
+  int nblocks = (int) (((int64_t) size + blocksize - 1) / blocksize);
+  if (nblocks > probe->maxblocks) {
+    entropy_probe_block *new_blocks = realloc(probe->blocks, nblocks * sizeof(entropy_probe_block));
+    BLOSC_ERROR_NULL(new_blocks, BLOSC2_ERROR_MEMORY_ALLOC);
+    probe->blocks = new_blocks;
+    probe->maxblocks = nblocks;
+  }
+
+  nblocks = entropy_probe_blocks((const uint8_t *) src, size, blocksize, budget, probe->pool,
+                                 probe->blocks);
+
+  blosc_set_timestamp(&t1);
+  probe->last_time = blosc_elapsed_secs(t0, t1);
+  probe->total_time += probe->last_time;
+  probe->total_bytes += size;
+
+  *blocks = probe->blocks;
+  return nblocks;
+}
+
+void btune_probe_free(btune_probe *probe) {
+  btune_pool_free(probe->pool);
+  probe->pool = NULL;
+  free(probe->blocks);
+  probe->blocks = NULL;
+  probe->maxblocks = 0;
+}
@@ -0,0 +1,62 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_probe.h
+ * @brief Btune entropy probe.
+ *
+ * Runs the entropy probe directly over the blocks of a chunk, in parallel, to
+ * get the per-block cratio and cspeed used as model inputs.  The thread pool
+ * and the features buffer are kept from one chunk to the next, and the buffer
+ * only grows when a chunk has more blocks than any before.
+ */
+
+#ifndef BTUNE_PROBE_H
+#define BTUNE_PROBE_H
+
+#include <stdint.h>
+#include "entropy_probe.h"
+#include "btune_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  btune_pool *pool;
+  // The threads probing the blocks (NULL if not created yet)
+  entropy_probe_block *blocks;
+  // Features of every block of the last probed chunk
+  int maxblocks;
+  // Number of blocks that fit in blocks
+  double last_time;
+  // Time spent in the last probe, in seconds
+  double total_time;
+  // Time spent in all the probes, in seconds
+  int64_t total_bytes;
+  // Bytes probed in all the probes
+} btune_probe;
+
+// Run the probe over `src`, split in blocks of `blocksize` bytes (a default
+// size if not positive) with `budget` bytes sampled in each one (see
+// entropy_probe_blocks()), and point `blocks` to the features of every block,
+// which are valid until the next call.  Returns the number of blocks, or a
+// negative value on errors.
+int btune_probe_run(btune_probe *probe, const void *src, int32_t size, int32_t blocksize,
+                    int32_t budget, entropy_probe_block **blocks);
+
+// Free the thread pool and the features buffer
+void btune_probe_free(btune_probe *probe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_PROBE_H */
@@ -0,0 +1,176 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdlib.h>
+
+#include "btune_sink.h"
+
+struct btune_sink {
+  blosc2_io_cb *io_cb;
+  // The wrapped callbacks
+  void *params;
+  // Their params
+  int64_t nbytes;
+  // Bytes written since the last btune_sink_take()
+  double secs;
+  // Seconds spent writing them
+  int nusers;
+  // Number of tuners measuring with it
+};
+
+// The streams opened by the wrapped callbacks, along with their sink
+typedef struct {
+  void *stream;
+  btune_sink *sink;
+} sink_stream;
+
+
+static void *sink_open(const char *urlpath, const char *mode, void *params) {
+  btune_sink *sink = (btune_sink *) params;
+  void *stream = sink->io_cb->open(urlpath, mode, sink->params);
+  if (stream == NULL) {
+    return NULL;
+  }
+  sink_stream *wrapper = malloc(sizeof(sink_stream));
+  if (wrapper == NULL) {
+    sink->io_cb->close(stream);
+    return NULL;
+  }
+  wrapper->stream = stream;
+  wrapper->sink = sink;
+  return wrapper;
+}
+
+static int sink_close(void *stream) {
+  sink_stream *wrapper = (sink_stream *) stream;
+  int rc = wrapper->sink->io_cb->close(wrapper->stream);
+  free(wrapper);
+  return rc;
+}
+
+static int64_t sink_size(void *stream) {
+  sink_stream *wrapper = (sink_stream *) stream;
+  return wrapper->sink->io_cb->size(wrapper->stream);
+}
+
+static int64_t sink_write(const void *ptr, int64_t size, int64_t nitems, int64_t position,
+                          void *stream) {
+  sink_stream *wrapper = (sink_stream *) stream;
+  btune_sink *sink = wrapper->sink;
+  blosc_timestamp_t t0, t1;
+  blosc_set_timestamp(&t0);
+  int64_t nwritten = sink->io_cb->write(ptr, size, nitems, position, wrapper->stream);
+  blosc_set_timestamp(&t1);
+  if (nwritten > 0) {
+    sink->nbytes += nwritten * size;
+    sink->secs += blosc_elapsed_secs(t0, t1);
+  }
+  return nwritten;
+}
+
+static int64_t sink_read(void **ptr, int64_t size, int64_t nitems, int64_t position,
+                         void *stream) {
+  sink_stream *wrapper = (sink_stream *) stream;
+  return wrapper->sink->io_cb->read(ptr, size, nitems, position, wrapper->stream);
+}
+
+static int sink_truncate(void *stream, int64_t size) {
+  sink_stream *wrapper = (sink_stream *) stream;
+  return wrapper->sink->io_cb->truncate(wrapper->stream, size);
+}
+
+// Only called for the storages that still have the sink io when freed (the super-chunk
+// gets its own io back when its tuners are freed).  The sink belongs to the tuners.
+static int sink_destroy(void *params) {
+  btune_sink *sink = (btune_sink *) params;
+  int rc = 0;
+  if (sink->io_cb->destroy != NULL) {
+    rc = sink->io_cb->destroy(sink->params);
+  }
+  return rc;
+}
+
+static bool register_sink_io(void) {
+  static bool registered = false;
+  if (registered) {
+    return true;
+  }
+  blosc2_io_cb io_cb;
+  io_cb.id = BTUNE_SINK_IO_ID;
+  io_cb.name = "btune_sink";
+  io_cb.is_allocation_necessary = true;
+  io_cb.open = sink_open;
+  io_cb.close = sink_close;
+  io_cb.size = sink_size;
+  io_cb.write = sink_write;
+  io_cb.read = sink_read;
+  io_cb.truncate = sink_truncate;
+  io_cb.destroy = sink_destroy;
+  if (blosc2_register_io_cb(&io_cb) < 0) {
+    // The id may be taken by someone else
+    blosc2_io_cb *current = blosc2_get_io_cb(BTUNE_SINK_IO_ID);
+    if (current == NULL || current->write != sink_write) {
+      return false;
+    }
+  }
+  registered = true;
+  return true;
+}
+
+btune_sink *btune_sink_attach(blosc2_schunk *schunk) {
+  blosc2_storage *storage = schunk->storage;
+  if (storage == NULL || storage->urlpath == NULL || storage->io == NULL) {
+    return NULL;
+  }
+  blosc2_io *io = storage->io;
+  if (io->id == BTUNE_SINK_IO_ID) {
+    // Already measured by the tuner of another context of the super-chunk
+    btune_sink *sink = (btune_sink *) io->params;
+    sink->nusers++;
+    return sink;
+  }
+  blosc2_io_cb *io_cb = blosc2_get_io_cb(io->id);
+  // Backends that allocate the data they read (e.g. mmap) keep it beyond the calls
+  if (io_cb == NULL || !io_cb->is_allocation_necessary || !register_sink_io()) {
+    return NULL;
+  }
+
+  btune_sink *sink = calloc(1, sizeof(btune_sink));
+  if (sink == NULL) {
+    return NULL;
+  }
+  sink->io_cb = io_cb;
+  sink->params = io->params;
+  sink->nusers = 1;
+  io->params = sink;
+  io->id = BTUNE_SINK_IO_ID;
+  return sink;
+}
+
+void btune_sink_detach(blosc2_schunk *schunk, btune_sink *sink) {
+  if (--sink->nusers > 0) {
+    return;
+  }
+  blosc2_io *io = schunk->storage->io;
+  if (io->id == BTUNE_SINK_IO_ID && io->params == sink) {
+    io->id = sink->io_cb->id;
+    io->params = sink->params;
+  }
+  free(sink);
+}
+
+bool btune_sink_take(btune_sink *sink, int64_t *nbytes, double *secs) {
+  *nbytes = sink->nbytes;
+  *secs = sink->secs;
+  sink->nbytes = 0;
+  sink->secs = 0;
+  return *nbytes > 0;
+}
@@ -0,0 +1,56 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_sink.h
+ * @brief Measurement of the write throughput of the frame of a super-chunk.
+ *
+ * The io callbacks of the frame are wrapped with ones that forward every call
+ * to them and time the writes, so that the real bandwidth of the storage
+ * backend (a local disk, a network filesystem...) can be used for scoring.
+ */
+
+#ifndef BTUNE_SINK_H
+#define BTUNE_SINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <blosc2.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Id under which the wrapping io callbacks are registered
+#define BTUNE_SINK_IO_ID 250
+
+// Shared by the tuners measuring the same super-chunk, and freed with the last one.
+// While attached, the io of the storage of the super-chunk is the one of the sink,
+// so copies of that storage must not outlive the tuners.
+typedef struct btune_sink btune_sink;
+
+// Start measuring the writes of the frame of `schunk` (or return the sink already
+// measuring them).  Returns NULL if the super-chunk is not stored in files, or if
+// its io callbacks cannot be wrapped.
+btune_sink *btune_sink_attach(blosc2_schunk *schunk);
+
+// Stop measuring with `sink`.  The last tuner detaching gives the super-chunk its
+// own io back and frees the sink.
+void btune_sink_detach(blosc2_schunk *schunk, btune_sink *sink);
+
+// Take the bytes written and the seconds spent writing them since the last call.
+// Returns whether anything was written.
+bool btune_sink_take(btune_sink *sink, int64_t *nbytes, double *secs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_SINK_H */
@@ -0,0 +1,287 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "btune_trial.h"
+
+
+// Ratio estimator of the total of some magnitude over `npop` blocks (adding up `total_size`
+// bytes) from `n` sampled blocks.  The half width of the confidence interval goes in `ci`.
+static double ratio_estimate(const double *values, const double *sizes, int n, int32_t npop,
+                             double total_size, double *ci) {
+  double sum_values = 0;
+  double sum_sizes = 0;
+  for (int i = 0; i < n; i++) {
+    sum_values += values[i];
+    sum_sizes += sizes[i];
+  }
+  double ratio = sum_values / sum_sizes;
+
+  *ci = 0;
+  if (n > 1 && n < npop) {
+    double ss = 0;
+    for (int i = 0; i < n; i++) {
+      double residual = values[i] - ratio * sizes[i];
+      ss += residual * residual;
+    }
+    // Finite population correction, as blocks are sampled without replacement
+    double f = (double) n / (double) npop;
+    *ci = BTUNE_TRIAL_CI_Z * npop * sqrt((1 - f) * ss / (n - 1) / n);
+  }
+
+  return ratio * total_size;
+}
+
+// Blocks that can be processed at the same time
+static int parallel_blocks(int nthreads, int32_t nblocks) {
+  int nparallel = (nthreads < nblocks) ? nthreads : nblocks;
+  return (nparallel < 1) ? 1 : nparallel;
+}
+
+// xorshift32 PRNG
+static uint32_t next_random(uint32_t *seed) {
+  uint32_t x = *seed ? *seed : 2463534242U;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+
+int btune_trial_run(const blosc2_cparams *cparams, const void *src, int32_t srcsize,
+                    uint8_t *cbuffer, uint8_t *dbuffer, int nthreads_decomp, btune_trial *trial) {
+  blosc_timestamp_t t0, t1;
+  trial->nbytes = srcsize;
+  trial->cbytes = -1;
+  trial->ctime = 0;
+  trial->dtime = 0;
+  trial->nsamples = 0;
+  trial->cbytes_ci = 0;
+  trial->ctime_ci = 0;
+  trial->dtime_ci = 0;
+
+  blosc2_context *cctx = blosc2_create_cctx(*cparams);
+  if (cctx == NULL) {
+    return BLOSC2_ERROR_FAILURE;
+  }
+  blosc_set_timestamp(&t0);
+  int cbytes = blosc2_compress_ctx(cctx, src, srcsize, cbuffer, srcsize + BLOSC2_MAX_OVERHEAD);
+  blosc_set_timestamp(&t1);
+  blosc2_free_ctx(cctx);
+  if (cbytes <= 0) {
+    // The output buffer is always large enough, so 0 is an error too
+    return cbytes < 0 ? cbytes : BLOSC2_ERROR_FAILURE;
+  }
+  trial->cbytes = cbytes;
+  trial->ctime = blosc_elapsed_secs(t0, t1);
+
+  if (dbuffer != NULL) {
+    blosc2_dparams dparams = BLOSC2_DPARAMS_DEFAULTS;
+    dparams.nthreads = (int16_t) nthreads_decomp;
+    blosc2_context *dctx = blosc2_create_dctx(dparams);
+    if (dctx == NULL) {
+      return BLOSC2_ERROR_FAILURE;
+    }
+    blosc_set_timestamp(&t0);
+    int dbytes = blosc2_decompress_ctx(dctx, cbuffer, cbytes, dbuffer, srcsize);
+    blosc_set_timestamp(&t1);
+    blosc2_free_ctx(dctx);
+    if (dbytes < 0) {
+      fprintf(stderr, "Error %d decompressing trial chunk\n", dbytes);
+      return dbytes;
+    }
+    trial->dtime = blosc_elapsed_secs(t0, t1);
+  }
+
+  return BLOSC2_ERROR_SUCCESS;
+}
+
+int btune_sample_blocks(btune_sampling_mode mode, int nsamples, int32_t nblocks, uint32_t *seed,
+                        int32_t *blocks) {
+  if (nsamples >= nblocks) {
+    for (int32_t i = 0; i < nblocks; i++) {
+      blocks[i] = i;
+    }
+    return nblocks;
+  }
+
+  switch (mode) {
+    case BTUNE_SAMPLE_RANDOM: {
+      // Selection sampling (Knuth's algorithm S), it keeps the indices sorted
+      int nchosen = 0;
+      for (int32_t i = 0; i < nblocks && nchosen < nsamples; i++) {
+        double u = (double) next_random(seed) / 4294967296.;
+        if (u * (nblocks - i) < (nsamples - nchosen)) {
+          blocks[nchosen++] = i;
+        }
+      }
+      return nchosen;
+    }
+    case BTUNE_SAMPLE_STRIDED:
+    default:
+      // Take the block in the middle of every stride
+      for (int i = 0; i < nsamples; i++) {
+        blocks[i] = (int32_t) (((2 * (int64_t) i + 1) * nblocks) / (2 * nsamples));
+      }
+      return nsamples;
+  }
+}
+
+int btune_trial_run_sampled(const blosc2_cparams *cparams, const void *src, int32_t srcsize,
+                            int32_t blocksize, const int32_t *blocks, int nsamples,
+                            uint8_t *cbuffer, uint8_t *dbuffer, int nthreads_decomp,
+                            btune_trial *trial) {
+  blosc_timestamp_t t0, t1;
+  trial->nbytes = srcsize;
+  trial->cbytes = -1;
+  trial->ctime = 0;
+  trial->dtime = 0;
+  trial->nsamples = nsamples;
+  trial->cbytes_ci = 0;
+  trial->ctime_ci = 0;
+  trial->dtime_ci = 0;
+
+  // Every block is compressed as a chunk on its own, so a single thread is enough
+  blosc2_cparams block_cparams = *cparams;
+  block_cparams.blocksize = blocksize;
+  block_cparams.nthreads = 1;
+  blosc2_context *cctx = blosc2_create_cctx(block_cparams);
+  blosc2_context *dctx = NULL;
+  if (dbuffer != NULL) {
+    blosc2_dparams dparams = BLOSC2_DPARAMS_DEFAULTS;
+    dctx = blosc2_create_dctx(dparams);
+  }
+  double *values = malloc(4 * nsamples * sizeof(double));
+  double *csizes = values;
+  double *ctimes = values + nsamples;
+  double *dtimes = values + 2 * nsamples;
+  double *sizes = values + 3 * nsamples;
+
+  int rc = BLOSC2_ERROR_SUCCESS;
+  if (cctx == NULL || (dbuffer != NULL && dctx == NULL) || values == NULL) {
+    rc = BLOSC2_ERROR_FAILURE;
+  }
+  for (int i = 0; i < nsamples && rc == BLOSC2_ERROR_SUCCESS; i++) {
+    int32_t start = blocks[i] * blocksize;
+    int32_t size = (srcsize - start < blocksize) ? srcsize - start : blocksize;
+    const uint8_t *block = (const uint8_t *) src + start;
+
+    blosc_set_timestamp(&t0);
+    int cbytes = blosc2_compress_ctx(cctx, block, size, cbuffer, size + BLOSC2_MAX_OVERHEAD);
+    blosc_set_timestamp(&t1);
+    if (cbytes <= 0) {
+      rc = cbytes < 0 ? cbytes : BLOSC2_ERROR_FAILURE;
+      break;
+    }
+    // The chunk header is only paid once in the whole buffer
+    cbytes -= BLOSC_EXTENDED_HEADER_LENGTH;
+    csizes[i] = (cbytes > 0) ? cbytes : 0;
+    ctimes[i] = blosc_elapsed_secs(t0, t1);
+    sizes[i] = size;
+
+    if (dctx != NULL) {
+      blosc_set_timestamp(&t0);
+      int dbytes = blosc2_decompress_ctx(dctx, cbuffer, cbytes + BLOSC_EXTENDED_HEADER_LENGTH,
+                                         dbuffer, size);
+      blosc_set_timestamp(&t1);
+      if (dbytes < 0) {
+        fprintf(stderr, "Error %d decompressing trial block\n", dbytes);
+        rc = dbytes;
+        break;
+      }
+      dtimes[i] = blosc_elapsed_secs(t0, t1);
+    }
+  }
+
+  if (rc == BLOSC2_ERROR_SUCCESS) {
+    int32_t nblocks = srcsize / blocksize + ((srcsize % blocksize) > 0);
+    double cbytes = ratio_estimate(csizes, sizes, nsamples, nblocks, srcsize, &trial->cbytes_ci);
+    trial->cbytes = (int32_t) (cbytes + 0.5) + BLOSC_EXTENDED_HEADER_LENGTH;
+    // Blocks are compressed in parallel in the real chunk
+    int cparallel = parallel_blocks(cparams->nthreads, nblocks);
+    trial->ctime = ratio_estimate(ctimes, sizes, nsamples, nblocks, srcsize, &trial->ctime_ci);
+    trial->ctime /= cparallel;
+    trial->ctime_ci /= cparallel;
+    if (dctx != NULL) {
+      int dparallel = parallel_blocks(nthreads_decomp, nblocks);
+      trial->dtime = ratio_estimate(dtimes, sizes, nsamples, nblocks, srcsize, &trial->dtime_ci);
+      trial->dtime /= dparallel;
+      trial->dtime_ci /= dparallel;
+    }
+  }
+
+  free(values);
+  if (cctx != NULL) {
+    blosc2_free_ctx(cctx);
+  }
+  if (dctx != NULL) {
+    blosc2_free_ctx(dctx);
+  }
+
+  return rc;
+}
+
+int btune_trial_dtime_sampled(blosc2_context *dctx, const uint8_t *cdata, int32_t cbytes,
+                              void *dest, int32_t nbytes, int32_t blocksize, int nthreads,
+                              const int32_t *blocks, int nsamples,
+                              double *dtime, double *dtime_ci) {
+  blosc_timestamp_t t0, t1;
+  int32_t nblocks = nbytes / blocksize + ((nbytes % blocksize) > 0);
+  bool *maskout = malloc(nblocks * sizeof(bool));
+  double *values = malloc(2 * nsamples * sizeof(double));
+  if (maskout == NULL || values == NULL) {
+    free(maskout);
+    free(values);
+    return BLOSC2_ERROR_MEMORY_ALLOC;
+  }
+  double *dtimes = values;
+  double *sizes = values + nsamples;
+  for (int32_t i = 0; i < nblocks; i++) {
+    maskout[i] = true;
+  }
+
+  int rc = BLOSC2_ERROR_SUCCESS;
+  for (int i = 0; i < nsamples; i++) {
+    // Decompress a single block of the chunk
+    maskout[blocks[i]] = false;
+    rc = blosc2_set_maskout(dctx, maskout, nblocks);
+    maskout[blocks[i]] = true;
+    if (rc < 0) {
+      break;
+    }
+    blosc_set_timestamp(&t0);
+    rc = blosc2_decompress_ctx(dctx, cdata, cbytes, dest, nbytes);
+    blosc_set_timestamp(&t1);
+    if (rc < 0) {
+      break;
+    }
+    int32_t start = blocks[i] * blocksize;
+    dtimes[i] = blosc_elapsed_secs(t0, t1);
+    sizes[i] = (nbytes - start < blocksize) ? nbytes - start : blocksize;
+  }
+
+  if (rc >= 0) {
+    int nparallel = parallel_blocks(nthreads, nblocks);
+    *dtime = ratio_estimate(dtimes, sizes, nsamples, nblocks, nbytes, dtime_ci);
+    *dtime /= nparallel;
+    *dtime_ci /= nparallel;
+    rc = BLOSC2_ERROR_SUCCESS;
+  }
+  free(values);
+  free(maskout);
+
+  return rc;
+}
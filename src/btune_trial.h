@@ -0,0 +1,84 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_trial.h
+ * @brief Trial compressions.
+ *
+ * Compress (and optionally decompress) a buffer with some candidate cparams
+ * outside of the production context, so that the candidate can be scored
+ * without its output reaching the super-chunk.
+ */
+
+#ifndef BTUNE_TRIAL_H
+#define BTUNE_TRIAL_H
+
+#include <stdbool.h>
+#include <blosc2.h>
+#include "btune_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The z value for the confidence intervals of sampled trials (95%)
+#define BTUNE_TRIAL_CI_Z 1.96
+
+// Measurements of a trial compression
+typedef struct {
+  int32_t nbytes;
+  // The number of uncompressed bytes
+  int32_t cbytes;
+  // The number of compressed bytes (negative on errors)
+  double ctime;
+  // The compression time
+  double dtime;
+  // The decompression time (0 if not measured)
+  int nsamples;
+  // The number of sampled blocks (0 if the whole buffer was used)
+  double cbytes_ci;
+  // Half width of the confidence interval for cbytes (0 if not sampled)
+  double ctime_ci;
+  // Half width of the confidence interval for ctime (0 if not sampled)
+  double dtime_ci;
+  // Half width of the confidence interval for dtime (0 if not sampled)
+} btune_trial;
+
+// Compress `src` with `cparams` into `cbuffer` (at least srcsize + BLOSC2_MAX_OVERHEAD bytes).
+// If `dbuffer` is not NULL, the compressed data is decompressed into it with `nthreads_decomp`
+// threads for measuring the decompression time.
+int btune_trial_run(const blosc2_cparams *cparams, const void *src, int32_t srcsize,
+                    uint8_t *cbuffer, uint8_t *dbuffer, int nthreads_decomp, btune_trial *trial);
+
+// Choose `nsamples` (sorted) block indices out of `nblocks` following `mode`.  The `seed` is
+// updated for BTUNE_SAMPLE_RANDOM.  Returns the number of chosen blocks.
+int btune_sample_blocks(btune_sampling_mode mode, int nsamples, int32_t nblocks, uint32_t *seed,
+                        int32_t *blocks);
+
+// Like btune_trial_run, but only the `blocks` of `blocksize` bytes are compressed (one by one,
+// each as its own chunk) and the results are extrapolated to the whole buffer, with confidence
+// bounds.  `cbuffer` needs blocksize + BLOSC2_MAX_OVERHEAD bytes and `dbuffer` blocksize bytes.
+int btune_trial_run_sampled(const blosc2_cparams *cparams, const void *src, int32_t srcsize,
+                            int32_t blocksize, const int32_t *blocks, int nsamples,
+                            uint8_t *cbuffer, uint8_t *dbuffer, int nthreads_decomp,
+                            btune_trial *trial);
+
+// Measure the decompression time of the chunk in `cdata` by decompressing only the `blocks`
+// (using the block maskout of `dctx`) and extrapolate it to the whole chunk.
+int btune_trial_dtime_sampled(blosc2_context *dctx, const uint8_t *cdata, int32_t cbytes,
+                              void *dest, int32_t nbytes, int32_t blocksize, int nthreads,
+                              const int32_t *blocks, int nsamples,
+                              double *dtime, double *dtime_ci);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_TRIAL_H */
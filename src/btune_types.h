@@ -0,0 +1,361 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_types.h
+ * @brief Btune types.
+ *
+ * This file contains the enumerations and the config structure of Btune, without
+ * the default config, so that it can be included by every source file of the plugin.
+ */
+
+#ifndef BTUNE_TYPES_H
+#define BTUNE_TYPES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+#if defined(_WIN32)
+#include <windows.h>
+#ifndef PATH_MAX
+#define PATH_MAX MAX_PATH
+#endif
+#else
+#include <limits.h>
+#endif
+
+// Version numbers
+#define BTUNE_VERSION_MAJOR    1    /* for major interface/format changes  */
+#define BTUNE_VERSION_MINOR    2    /* for minor interface/format changes  */
+#define BTUNE_VERSION_RELEASE  2    /* for tweaks, bug-fixes, or development */
+#define BTUNE_VERSION_STRING "1.2.2.dev0"
+// Maximum number of codecs
+#define BTUNE_MAX_CODECS 8
+#define BTUNE_MAX_FILTERS 3
+#define BTUNE_MAX_CLEVELS 9
+#define BTUNE_MAX_BLOCKSIZES 16
+
+#define BTUNE_TRACE(msg, ...) \
+    do { \
+         const char *__e = getenv("BTUNE_TRACE"); \
+         if (!__e) { break; } \
+         fprintf(stderr, "TRACE: " msg "\n", ##__VA_ARGS__); \
+       } while(0)
+
+
+/**
+ * @brief Btune units enumeration.
+ *
+ * This enumeration provides the most common units of bandwidth for its use
+ * in the Btune config. The bandwidth units are expressed in kB/s.
+*/
+enum bandwidth_units{
+  BTUNE_MBPS = 1024,                                  //!< A 1 MB/s bandwidth expressed in kB/s, 1024 kB/s.
+  BTUNE_MBPS10 = 10 * BTUNE_MBPS,                     //!< A 10 MB/s bandwidth expressed in kB/s, 10240 kB/s.
+  BTUNE_MBPS100 = 100 * BTUNE_MBPS,                   //!< A 100 MB/s bandwidth expressed in kB/s, 102400 kB/s.
+  BTUNE_GBPS = 1 * BTUNE_MBPS * BTUNE_MBPS,           //!< A 1 GB/s bandwidth expressed in kB/s, 1024^2 kB/s.
+  BTUNE_GBPS10 = 10 * BTUNE_MBPS * BTUNE_MBPS,        //!< A 10 GB/s bandwidth expressed in kB/s, 10 * 1024^2 kB/s.
+  BTUNE_GBPS100 = 100 * BTUNE_MBPS * BTUNE_MBPS,      //!< A 100 GB/s bandwidth expressed in kB/s, 100 * 1024^2 kB/s.
+  BTUNE_TBPS = BTUNE_MBPS * BTUNE_MBPS * BTUNE_MBPS,  //!< A 1 TB/s bandwidth expressed in kB/s, 1024^3 kB/s.
+};
+
+/**
+ * @brief Compression mode enumeration.
+ *
+ * The compression mode alters the Btune criteria for improvement.
+ * Depending on this value Btune will prioritize the compression/decompression speed,
+ * the compression ratio or both.
+*/
+#define BTUNE_COMP_HSP 0.1F      //!< Optimizes the speed, even accepting memcpy.
+#define BTUNE_COMP_BALANCED 0.5F  //!< Optimizes both, the speed and compression ratio.
+#define BTUNE_COMP_HCR 0.9F       //!< Optimizes the compression ratio.
+
+
+/**
+ * @brief Performance mode enumeration.
+ *
+ * The performance mode alters the Btune scoring function used for improvement.
+ * Depending on this value Btune will consider for the scoring either the compression time or
+ * the decompression time, or both.
+*/
+typedef enum {
+  BTUNE_PERF_COMP,     //!< Optimizes the compression and transmission times.
+  BTUNE_PERF_DECOMP,   //!< Optimizes the decompression and transmission times.
+  BTUNE_PERF_BALANCED, //!< Optimizes the compression, transmission and decompression times.
+  BTUNE_PERF_AUTO,     //!< Gets mode from environment variable, defaults to PERF_COMP
+  BTUNE_PERF_SLO,      //!< Maximizes the cratio within the latency targets (slo_ctime and slo_dtime).
+  BTUNE_PERF_THROUGHPUT, //!< Maximizes the cratio above the speed floors (min_cspeed and min_dspeed).
+} btune_performance_mode;
+
+/**
+ * @brief Repeat mode enumeration.
+ *
+ * Changes the way Btune behaves when it has completed all the initial readaptations.
+ * @see #btune_behaviour
+*/
+typedef enum {
+  BTUNE_STOP,         //!< Btune will stop improving.
+  BTUNE_REPEAT_SOFT,  //!< Btune will repeat only the soft readapts continuously.
+  BTUNE_REPEAT_ALL,   //!< Btune will repeat the initial readaptations continuously.
+} btune_repeat_mode;
+
+/**
+ * @brief Sampling mode enumeration.
+ *
+ * Selects which blocks of a chunk are used for scoring the trial candidates.
+ * When sampling, the trial cost scales with the number of sampled blocks instead
+ * of with the chunk size, and the measurements are extrapolated to the whole chunk.
+*/
+typedef enum {
+  BTUNE_SAMPLE_NONE,     //!< Use the whole chunk.
+  BTUNE_SAMPLE_STRIDED,  //!< Use blocks evenly spread over the chunk.
+  BTUNE_SAMPLE_RANDOM,   //!< Use randomly chosen blocks.
+} btune_sampling_mode;
+
+/**
+ * @brief Search strategy enumeration.
+ *
+ * Selects how Btune explores the space of compression parameters.
+*/
+typedef enum {
+  BTUNE_SEARCH_HILL_CLIMBING,  //!< Hard and soft readapts driven by #btune_behaviour.
+  BTUNE_SEARCH_UCB,            //!< Upper confidence bound bandit over all the combinations.
+  BTUNE_SEARCH_THOMPSON,       //!< Thompson sampling bandit over all the combinations.
+} btune_search_strategy;
+
+/**
+ * @brief Aggregation enumeration.
+ *
+ * Selects how the repeated measurements of a candidate are combined into a single one.
+*/
+typedef enum {
+  BTUNE_AGG_MEAN,          //!< The arithmetic mean.
+  BTUNE_AGG_MEDIAN,        //!< The median.
+  BTUNE_AGG_TRIMMED_MEAN,  //!< The mean after discarding the lowest and highest quarters.
+} btune_aggregation;
+
+/**
+ * @brief Btune behaviour struct.
+ *
+ * This specifies the number of initial hard readapts,
+ * the number of soft readapts between each hard readapt and the number of waits,
+ * before initiating a readapt.
+ * Note: a readapt is the process by which btune adjusts the compression parameters.
+ * It can be of two types: \b soft, which only changes the compression level and
+ * blocksize or \b hard, which also changes the codec, filters and number of threads.
+*/
+typedef struct {
+  uint32_t nwaits_before_readapt;
+  /**< Number of waiting states before a readapt.
+   *
+   * During a waiting state Btune will not alter any compression parameter.
+  */
+  uint32_t nsofts_before_hard;
+  //!< Number of soft readapts before a hard readapt.
+  uint32_t nhards_before_stop;
+  //!< Number of initial hard readapts.
+  btune_repeat_mode repeat_mode;
+  /**< Btune repeat mode.
+   *
+   * Once completed the initial hard readapts, the repeat mode will determine
+   * if Btune continues repeating readapts or stops permanently.
+  */
+} btune_behaviour;
+
+/**
+ * @brief Btune configuration struct.
+ *
+ * The btune_config struct contains all the parameters used by Btune which determine
+ * how the compression parameters will be tuned.
+*/
+typedef struct {
+  uint32_t bandwidth;
+  /**< The bandwidth to which optimize in kB/s.
+   *
+   * Used to calculate the transmission times.
+  */
+  btune_performance_mode perf_mode;
+  //!< The Btune performance mode.
+  float tradeoff[3];
+  //!< The Btune compression mode (between 0 (speed) and 1 (cratio)).
+  int tradeoff_nelems;
+  // Number of values for tradeoff (3 or 1). This is automatically when using BTUNE_TRADEOFF or setting it through python.
+  btune_behaviour behaviour;
+  //!< The Btune behaviour config.
+  bool cparams_hint;
+  /**< Whether use the cparams specified in the context or not.
+   *
+   * When true, this will force Btune to use the cparams provided inside the context, note
+   * that after a hard readapt the cparams will change.
+   * When false, Btune will start from a hard readapt to determine the best cparams, note
+   * that this hard readapt is not considered for the number of initial hard readapts.
+   * @see #btune_behaviour
+  */
+  int use_inference;
+  //!< Number of times inference is applied. If -1, always apply inference.
+  char models_dir[PATH_MAX];
+  //!< The directory where the desired models and meta to use are stored.
+  bool speculative;
+  /**< Whether to evaluate all the codec/filter candidates of a hard readapt at once.
+   *
+   * When true, the candidates are compressed in parallel over the same chunk
+   * and only the winner is used for the chunk that is actually stored, so a
+   * hard readapt finishes in a single chunk.
+  */
+  btune_sampling_mode sampling_mode;
+  /**< Which blocks are used for scoring the trial candidates.
+   *
+   * It applies to the speculative evaluation of candidates and to the measurement
+   * of the decompression time in DECOMP and BALANCED modes.
+  */
+  int sample_nblocks;
+  //!< The number of blocks to sample when sampling_mode is not BTUNE_SAMPLE_NONE.
+  btune_search_strategy search;
+  /**< The search strategy.
+   *
+   * The bandit strategies treat every (codec, filter, split, clevel, nthreads)
+   * combination as an arm and ignore #btune_behaviour, as they never stop exploring.
+   * They are only used for lossless compression once the model inference (if any) is over.
+  */
+  bool drift_detection;
+  /**< Whether readapts are triggered by changes in the data.
+   *
+   * When true, the waits, softs and hards of #btune_behaviour are ignored after
+   * the first readapt: Btune stays in the waiting state and only does a hard
+   * readapt when the cratio, the score or the entropy probe of the chunks drift.
+  */
+  int nreps;
+  /**< The number of chunks measured for every candidate of a readapt.
+   *
+   * Values larger than 1 make the choice more robust against timing noise, at the
+   * cost of longer readapts.  Scores are normalized by the chunk size, so chunks
+   * of different sizes (e.g. the last one) can be compared fairly.
+  */
+  btune_aggregation aggregation;
+  //!< How the repeated measurements of a candidate are combined.
+  int nwarmups;
+  //!< The number of chunks compressed with every candidate before measuring (e.g. to warm the caches).
+  char cache_dir[PATH_MAX];
+  /**< The directory where the tuned cparams are cached (disabled if empty).
+   *
+   * The winner of the first hard readapt is cached under a fingerprint of the
+   * first chunk.  Later streams whose first chunk has the same fingerprint (and
+   * the same perf_mode, tradeoff and bandwidth) start from the cached cparams and
+   * skip the initial hard readapt, as if #cparams_hint was set.
+  */
+  bool persist_state;
+  /**< Whether the tuner state is kept in the vlmeta of the super-chunk.
+   *
+   * When true, the state (best cparams, Pareto front, readapt counters and model
+   * category counts) is stored in the "btune" vlmeta entry when the context is freed
+   * (or on btune_checkpoint()), and restored by btune_init() when the entry exists,
+   * so that appending to a reopened frame does not repeat the exploration.
+  */
+  bool async_dtime;
+  /**< Whether the decompression time is measured in a background thread.
+   *
+   * When true, the decompression of a chunk (in DECOMP and BALANCED modes) is
+   * timed while the caller prepares the next one, and the decision about its
+   * cparams is deferred to the next call to btune_next_cparams(), so that the
+   * latency of appending a chunk does not include a full decompression.
+  */
+  int probe_budget;
+  /**< The bytes probed in every block by the entropy probe (0 for only its head).
+   *
+   * By default the probe only looks at the first 8 KB of every block.  With a budget,
+   * several windows spread across the whole block are probed instead (8 KB windows,
+   * or smaller ones for budgets under 32 KB, so that there are at least 4), and the
+   * variance between them is computed too.
+  */
+  bool filter_pruning;
+  /**< Whether hard readapts without models skip the filters that are clearly worse.
+   *
+   * The byte lane and bit plane entropies of the chunk estimate how NOFILTER, SHUFFLE
+   * and BITSHUFFLE would do, and the filters estimated much worse than the best one
+   * are not tried.
+  */
+  bool codec_pruning;
+  /**< Whether hard readapts without models skip the codecs that are clearly worse.
+   *
+   * The chunk is parsed with the match windows and costs of BloscLZ, LZ4, ZLIB and
+   * ZSTD, and the codecs whose estimated cratio is much lower than the best one
+   * are not tried (LZ4 is always kept outside of HCR mode).
+  */
+  int cost_model_topk;
+  /**< The number of codec, filter and split candidates tried by hard readapts without models (0 for all).
+   *
+   * A cost model predicts the cratio, ctime and dtime of every candidate from the
+   * probes of the chunk and the calibration profile of the machine, and only the
+   * ones with the best predicted score are tried.  The model keeps learning from
+   * the real measurements.
+  */
+  bool sink_bandwidth;
+  /**< Whether the bandwidth of the score is measured from the writes of the super-chunk.
+   *
+   * For super-chunks stored in files, the io callbacks of the frame are timed, and a
+   * moving average of the bytes written per second replaces the bandwidth above.  For
+   * in-memory super-chunks, the memory bandwidth of the calibration profile is used.
+  */
+  float storage_latency;
+  /**< The latency in seconds of every request to the storage (0 for none).
+   *
+   * Together with the bandwidth, the IOPS and the request size below, it models the
+   * time for storing a compressed chunk: every request costs the latency, and the
+   * requests cannot be faster than the IOPS.  This favors the higher cratios on
+   * object stores or network filesystems, and not on local memory.
+  */
+  uint32_t storage_iops;
+  //!< The maximum requests per second of the storage (0 for unlimited).
+  int32_t storage_request_size;
+  //!< The maximum bytes of a request to the storage (0 for a request per chunk).
+  float slo_ctime;
+  /**< The p99 target for the compression time of a chunk in seconds (0 for none).
+   *
+   * Only used in the BTUNE_PERF_SLO mode, which chooses the cparams with the best
+   * cratio among the ones meeting the targets.  The p99 of a candidate is estimated
+   * from its measurements and from a rolling histogram of the compression times of
+   * the best cparams, and the best cparams are backed off as soon as the p99 of
+   * their chunks exceeds the target.
+  */
+  float slo_dtime;
+  //!< The p99 target for the decompression time of a chunk in seconds (0 for none).
+  uint32_t min_cspeed;
+  /**< The minimum compression speed in kB/s (0 for none).
+   *
+   * Only used in the BTUNE_PERF_THROUGHPUT mode, which chooses the cparams with the
+   * best cratio among the ones compressing (with all their threads) at least this fast.
+  */
+  uint32_t min_dspeed;
+  //!< The minimum decompression speed in kB/s (0 for none).
+} btune_config;
+
+/// @cond DEV
+// Internal Btune state enumeration.
+typedef enum {
+    CODEC_FILTER,
+    THREADS,
+    CLEVEL,
+    BLOCKSIZE,
+    MEMCPY,
+    WAITING,
+    STOP,
+} btune_state;
+
+// Internal Btune readapt type
+typedef enum {
+    WAIT,
+    SOFT,
+    HARD,
+} readapt_type;
+/// @endcond
+
+#endif  /* BTUNE_TYPES_H */
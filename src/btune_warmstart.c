@@ -0,0 +1,231 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <blosc2/filters-registry.h>
+#include "btune_file.h"
+#include "btune_warmstart.h"
+#include "entropy_probe.h"
+#include "json.h"
+
+// Version of the cache file format
+#define WARMSTART_VERSION 1
+// Windows of the chunk sampled for the byte histogram
+#define SKETCH_NWINDOWS 8
+#define SKETCH_WINDOW (4 * 1024)
+
+
+static void count_nibbles(const uint8_t *src, int32_t size, uint32_t *counts) {
+  for (int32_t i = 0; i < size; i++) {
+    counts[src[i] >> 4]++;
+  }
+}
+
+uint64_t btune_fingerprint(const uint8_t *src, int32_t size, int32_t typesize) {
+  // Histogram of the high nibbles, over a few windows spread over the chunk
+  uint32_t counts[16] = {0};
+  int64_t total = size;
+  if (size <= SKETCH_NWINDOWS * SKETCH_WINDOW) {
+    count_nibbles(src, size, counts);
+  } else {
+    total = SKETCH_NWINDOWS * SKETCH_WINDOW;
+    for (int i = 0; i < SKETCH_NWINDOWS; i++) {
+      int64_t start = ((2 * (int64_t) i + 1) * (size - SKETCH_WINDOW)) / (2 * SKETCH_NWINDOWS);
+      count_nibbles(src + start, SKETCH_WINDOW, counts);
+    }
+  }
+
+  // Quantize coarsely, so that similar data gets the same fingerprint
+  uint8_t features[2 + 16];
+  features[0] = (uint8_t) ((typesize < 255) ? typesize : 255);
+  double cratio = entropy_probe_cratio(src, size);
+  double level = 2 * log2(cratio > 1 ? cratio : 1);
+  features[1] = (uint8_t) ((level < 255) ? level : 255);
+  for (int i = 0; i < 16; i++) {
+    // 0 for an empty bin, else the log2 of the frequency in 1/1024 units (at least 1)
+    double freq = (total > 0) ? (double) counts[i] / (double) total : 0;
+    features[2 + i] = 0;
+    if (counts[i] > 0) {
+      double bin_level = 1 + floor(log2(freq * 1024));
+      features[2 + i] = (uint8_t) ((bin_level > 1) ? bin_level : 1);
+    }
+  }
+
+  return btune_fnv1a(BTUNE_FNV_OFFSET, features, sizeof(features));
+}
+
+// The best cparams depend on the config too, so it is part of the key
+static void cache_path(char *path, size_t size, const char *dir, uint64_t fingerprint,
+                       const btune_config *config) {
+  int32_t config_values[5] = {(int32_t) config->perf_mode, (int32_t) config->bandwidth,
+                              config->tradeoff_nelems, 0, 0};
+  uint64_t key = btune_fnv1a(BTUNE_FNV_OFFSET, &fingerprint, sizeof(fingerprint));
+  for (int i = 0; i < config->tradeoff_nelems && i < 2; i++) {
+    config_values[3 + i] = (int32_t) lroundf(config->tradeoff[i] * 100);
+  }
+  if (config->perf_mode == BTUNE_PERF_SLO) {
+    // The tradeoff is not used, but the latency targets (in us) are
+    config_values[3] = (int32_t) lroundf(config->slo_ctime * 1e6f);
+    config_values[4] = (int32_t) lroundf(config->slo_dtime * 1e6f);
+  } else if (config->perf_mode == BTUNE_PERF_THROUGHPUT) {
+    config_values[3] = (int32_t) config->min_cspeed;
+    config_values[4] = (int32_t) config->min_dspeed;
+  }
+  key = btune_fnv1a(key, config_values, sizeof(config_values));
+  snprintf(path, size, "%s/btune-%016" PRIx64 ".json", dir, key);
+}
+
+// Whether `filter` is one of the filters that Btune tries
+static bool is_known_filter(uint8_t filter) {
+  return filter < BLOSC_LAST_FILTER || filter == BLOSC_FILTER_BYTEDELTA ||
+         filter == BLOSC_FILTER_INT_TRUNC;
+}
+
+static int read_array(json_value *value, uint8_t *array, int size) {
+  if (value->type != json_array || (int) value->u.array.length != size) {
+    return -1;
+  }
+  for (int i = 0; i < size; i++) {
+    if (value->u.array.values[i]->type != json_integer) {
+      return -1;
+    }
+    array[i] = (uint8_t) value->u.array.values[i]->u.integer;
+  }
+  return 0;
+}
+
+int btune_warmstart_load(const char *dir, uint64_t fingerprint, const btune_config *config,
+                         cparams_btune *cparams) {
+  char path[PATH_MAX + 32];
+  cache_path(path, sizeof(path), dir, fingerprint, config);
+  size_t nread;
+  char *buffer = btune_file_read(path, &nread);
+  if (buffer == NULL) {
+    return -1;
+  }
+  json_value *json = json_parse(buffer, nread);
+  free(buffer);
+  if (json == NULL) {
+    return -1;
+  }
+
+  int rc = (json->type == json_object) ? 0 : -1;
+  int version = 0;
+  bool has_compcode = false;
+  for (unsigned int i = 0; rc == 0 && i < json->u.object.length; i++) {
+    const char *name = json->u.object.values[i].name;
+    json_value *value = json->u.object.values[i].value;
+    if (strcmp(name, "filters") == 0) {
+      rc = read_array(value, cparams->pipeline.filters, BLOSC2_MAX_FILTERS);
+      continue;
+    }
+    if (strcmp(name, "filters_meta") == 0) {
+      rc = read_array(value, cparams->pipeline.filters_meta, BLOSC2_MAX_FILTERS);
+      continue;
+    }
+    if (value->type != json_integer) {
+      continue;
+    }
+    int64_t integer = value->u.integer;
+    if (strcmp(name, "version") == 0) {
+      version = (int) integer;
+    }
+    else if (strcmp(name, "compcode") == 0) {
+      cparams->compcode = (int) integer;
+      has_compcode = true;
+    }
+    else if (strcmp(name, "compcode_meta") == 0) {
+      cparams->compcode_meta = (uint8_t) integer;
+    }
+    else if (strcmp(name, "filter") == 0) {
+      cparams->filter = (uint8_t) integer;
+    }
+    else if (strcmp(name, "filter_meta") == 0) {
+      cparams->filter_meta = (uint8_t) integer;
+    }
+    else if (strcmp(name, "splitmode") == 0) {
+      cparams->splitmode = (int32_t) integer;
+    }
+    else if (strcmp(name, "clevel") == 0) {
+      cparams->clevel = (int) integer;
+    }
+    else if (strcmp(name, "blocksize") == 0) {
+      cparams->blocksize = (int32_t) integer;
+    }
+    else if (strcmp(name, "nthreads_comp") == 0) {
+      cparams->nthreads_comp = (int) integer;
+    }
+    else if (strcmp(name, "nthreads_decomp") == 0) {
+      cparams->nthreads_decomp = (int) integer;
+    }
+  }
+  json_value_free(json);
+
+  if (rc < 0 || version != WARMSTART_VERSION || !has_compcode) {
+    return -1;
+  }
+  // The codecs and filters must be available in this process (e.g. plugins)
+  const char *compname;
+  if (blosc2_compcode_to_compname(cparams->compcode, &compname) < 0) {
+    return -1;
+  }
+  if (!is_known_filter(cparams->filter)) {
+    return -1;
+  }
+  for (int i = 0; i < BLOSC2_MAX_FILTERS; i++) {
+    if (!is_known_filter(cparams->pipeline.filters[i])) {
+      return -1;
+    }
+  }
+  if (cparams->clevel < 0 || cparams->clevel > 9) {
+    return -1;
+  }
+  return 0;
+}
+
+static void write_array(FILE *file, const char *name, const uint8_t *array, int size) {
+  fprintf(file, "  \"%s\": [", name);
+  for (int i = 0; i < size; i++) {
+    fprintf(file, (i == 0) ? "%d" : ", %d", array[i]);
+  }
+  fprintf(file, "],\n");
+}
+
+int btune_warmstart_save(const char *dir, uint64_t fingerprint, const btune_config *config,
+                         const cparams_btune *cparams) {
+  char path[PATH_MAX + 32];
+  char tmp_path[PATH_MAX + 64];
+  cache_path(path, sizeof(path), dir, fingerprint, config);
+  FILE *file = btune_file_create(path, tmp_path, sizeof(tmp_path));
+  if (file == NULL) {
+    return -1;
+  }
+  fprintf(file, "{\n");
+  fprintf(file, "  \"version\": %d,\n", WARMSTART_VERSION);
+  fprintf(file, "  \"compcode\": %d,\n", cparams->compcode);
+  fprintf(file, "  \"compcode_meta\": %d,\n", cparams->compcode_meta);
+  fprintf(file, "  \"filter\": %d,\n", cparams->filter);
+  fprintf(file, "  \"filter_meta\": %d,\n", cparams->filter_meta);
+  write_array(file, "filters", cparams->pipeline.filters, BLOSC2_MAX_FILTERS);
+  write_array(file, "filters_meta", cparams->pipeline.filters_meta, BLOSC2_MAX_FILTERS);
+  fprintf(file, "  \"splitmode\": %d,\n", cparams->splitmode);
+  fprintf(file, "  \"clevel\": %d,\n", cparams->clevel);
+  fprintf(file, "  \"blocksize\": %d,\n", cparams->blocksize);
+  fprintf(file, "  \"nthreads_comp\": %d,\n", cparams->nthreads_comp);
+  fprintf(file, "  \"nthreads_decomp\": %d\n", cparams->nthreads_decomp);
+  fprintf(file, "}\n");
+  return btune_file_commit(file, tmp_path, path);
+}
@@ -0,0 +1,47 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  btune_warmstart.h
+ * @brief On-disk cache of tuned cparams, keyed by data fingerprints.
+ *
+ * The winner of the first hard readapt of a stream is stored in a small JSON
+ * file named after a fingerprint of the first chunk and the tuning config, so
+ * that later streams of the same kind of data can start from it.
+ */
+
+#ifndef BTUNE_WARMSTART_H
+#define BTUNE_WARMSTART_H
+
+#include <stdint.h>
+#include "btune-private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compact fingerprint of a chunk: a hash of its typesize, its entropy probe
+// estimate and a sketch of its byte histogram, all coarsely quantized.
+uint64_t btune_fingerprint(const uint8_t *src, int32_t size, int32_t typesize);
+
+// Read the cparams cached in `dir` for `fingerprint` and `config`.  Only the
+// parameters are filled, not the measurements.  Returns 0 on a hit, -1 otherwise.
+int btune_warmstart_load(const char *dir, uint64_t fingerprint, const btune_config *config,
+                         cparams_btune *cparams);
+
+// Cache `cparams` in `dir` for `fingerprint` and `config`.  Returns 0 on success.
+int btune_warmstart_save(const char *dir, uint64_t fingerprint, const btune_config *config,
+                         const cparams_btune *cparams);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* BTUNE_WARMSTART_H */
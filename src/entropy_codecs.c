@@ -0,0 +1,172 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <blosc2.h>
+#include "entropy_codecs.h"
+#include "entropy_probe.h"
+
+// Windows of the chunk parsed (the whole chunk if it is not larger than all of them)
+#define NWINDOWS 4
+#define WINDOW (128 * 1024)
+#define MIN_MATCH 4
+#define HASH_MULTIPLIER 2654435761U
+
+// Parameters of a LZ77 parser standing for a codec family
+typedef struct {
+  int hash_log;
+  int32_t max_distance;
+  float match_cost;
+  // Bytes for the offset, length and token of every match
+  bool entropy_literals;
+  // Whether literals are entropy coded (else they take a byte each)
+} lz_profile;
+
+// BloscLZ is estimated by the regular entropy probe
+static const lz_profile profiles[ENTROPY_NCODECS] = {
+  [ENTROPY_CODEC_LZ4] = {12, 65535, 3.f, false},
+  [ENTROPY_CODEC_ZLIB] = {15, 32768, 2.5f, true},
+  [ENTROPY_CODEC_ZSTD] = {17, WINDOW, 3.f, true},
+};
+
+#define READU32(p) (*(const uint32_t *) (p))
+
+
+static int32_t match_length(const uint8_t *a, const uint8_t *b, const uint8_t *end) {
+  const uint8_t *start = b;
+  while (b + 8 <= end && *(const uint64_t *) a == *(const uint64_t *) b) {
+    a += 8;
+    b += 8;
+  }
+  while (b < end && *a == *b) {
+    a++;
+    b++;
+  }
+  return (int32_t) (b - start);
+}
+
+// Order-0 entropy of a buffer, in bits per byte
+static double entropy(const uint8_t *src, int32_t size) {
+  uint32_t hist[256] = {0};
+  for (int32_t i = 0; i < size; i++) {
+    hist[src[i]]++;
+  }
+  double h = 0;
+  for (int i = 0; i < 256; i++) {
+    if (hist[i] > 0) {
+      double p = (double) hist[i] / size;
+      h -= p * log2(p);
+    }
+  }
+  return h;
+}
+
+// Greedy LZ77 parse of a window with the given profile.  `htab` has room for
+// 1 << hash_log positions (stored plus one, so that 0 means none).
+static double lz_cost(const uint8_t *src, int32_t size, const lz_profile *profile,
+                      double literal_bits, uint32_t *htab) {
+  memset(htab, 0, (sizeof(uint32_t)) << profile->hash_log);
+  const uint8_t *end = src + size;
+  int shift = 32 - profile->hash_log;
+  double nliterals = 0;
+  double nmatches = 0;
+  double extra_bytes = 0;
+  int32_t i = 0;
+  while (i + MIN_MATCH <= size) {
+    uint32_t seq = READU32(src + i);
+    uint32_t hval = (seq * HASH_MULTIPLIER) >> shift;
+    uint32_t candidate = htab[hval];
+    htab[hval] = (uint32_t) i + 1;
+    if (candidate > 0 && i - (int32_t) (candidate - 1) <= profile->max_distance &&
+        READU32(src + candidate - 1) == seq) {
+      int32_t len = MIN_MATCH + match_length(src + candidate - 1 + MIN_MATCH, src + i + MIN_MATCH, end);
+      nmatches++;
+      // Long lengths take extra bytes
+      extra_bytes += (len - MIN_MATCH) / 255;
+      i += len;
+      // Keep the table fresh at the end of the match
+      if (i + MIN_MATCH <= size && i >= 2) {
+        uint32_t tail = READU32(src + i - 2);
+        htab[(tail * HASH_MULTIPLIER) >> shift] = (uint32_t) (i - 2) + 1;
+      }
+    }
+    else {
+      nliterals++;
+      i++;
+    }
+  }
+  nliterals += size - i;
+
+  double literal_bytes = profile->entropy_literals ? nliterals * literal_bits / 8 : nliterals;
+  return literal_bytes + nmatches * profile->match_cost + extra_bytes;
+}
+
+int entropy_codecs_probe(const uint8_t *src, int32_t size, float *cratios) {
+  for (int codec = 0; codec < ENTROPY_NCODECS; codec++) {
+    cratios[codec] = 1.f;
+  }
+  if (size < 32) {
+    return 0;
+  }
+  uint32_t *htab = malloc((sizeof(uint32_t)) << profiles[ENTROPY_CODEC_ZSTD].hash_log);
+  if (htab == NULL) {
+    return BLOSC2_ERROR_MEMORY_ALLOC;
+  }
+
+  int nwindows = NWINDOWS;
+  int32_t window = WINDOW;
+  if (size <= NWINDOWS * WINDOW) {
+    nwindows = 1;
+    window = size;
+  }
+  double costs[ENTROPY_NCODECS] = {0};
+  double blosclz = 0;
+  for (int i = 0; i < nwindows; i++) {
+    const uint8_t *start = src;
+    if (nwindows > 1) {
+      start += ((2 * (int64_t) i + 1) * (size - window)) / (2 * nwindows);
+    }
+    // All the codecs parse the same window while it is in cache
+    blosclz += entropy_probe_cratio(start, window);
+    double literal_bits = entropy(start, window);
+    for (int codec = ENTROPY_CODEC_LZ4; codec < ENTROPY_NCODECS; codec++) {
+      costs[codec] += lz_cost(start, window, &profiles[codec], literal_bits, htab);
+    }
+  }
+  free(htab);
+
+  cratios[ENTROPY_CODEC_BLOSCLZ] = (float) (blosclz / nwindows);
+  for (int codec = ENTROPY_CODEC_LZ4; codec < ENTROPY_NCODECS; codec++) {
+    double cost = (costs[codec] > 1) ? costs[codec] : 1;
+    cratios[codec] = (float) ((double) nwindows * window / cost);
+  }
+  return 0;
+}
+
+int entropy_codecs_family(int compcode) {
+  switch (compcode) {
+    case BLOSC_BLOSCLZ:
+      return ENTROPY_CODEC_BLOSCLZ;
+    case BLOSC_LZ4:
+    case BLOSC_LZ4HC:
+      return ENTROPY_CODEC_LZ4;
+    case BLOSC_ZLIB:
+      return ENTROPY_CODEC_ZLIB;
+    case BLOSC_ZSTD:
+      return ENTROPY_CODEC_ZSTD;
+    default:
+      return -1;
+  }
+}
@@ -0,0 +1,51 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  entropy_codecs.h
+ * @brief Cratio estimates of a chunk for several codec families.
+ *
+ * The BloscLZ-like entropy probe only sees matches within 8 KB, so it
+ * underestimates the codecs with long windows.  Here the same windows of a
+ * chunk are also parsed with the match distances, hash sizes and sequence
+ * costs of LZ4, ZLIB and ZSTD (the last two with entropy coded literals), so
+ * that the codecs can be ranked before trying them.
+ */
+
+#ifndef ENTROPY_CODECS_H
+#define ENTROPY_CODECS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Codec families emulated by entropy_codecs_probe()
+typedef enum {
+  ENTROPY_CODEC_BLOSCLZ,
+  ENTROPY_CODEC_LZ4,
+  ENTROPY_CODEC_ZLIB,
+  ENTROPY_CODEC_ZSTD,
+  ENTROPY_NCODECS,
+} entropy_codec;
+
+// Estimate the cratio of `src` for every codec family (cratios must have room
+// for ENTROPY_NCODECS values).  Returns 0 on success, or a negative value.
+int entropy_codecs_probe(const uint8_t *src, int32_t size, float *cratios);
+
+// The family emulating a blosc2 compcode (-1 if none does)
+int entropy_codecs_family(int compcode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ENTROPY_CODECS_H */
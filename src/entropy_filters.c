@@ -0,0 +1,154 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include <blosc2.h>
+#include "entropy_filters.h"
+
+// Larger typesizes are probed as a single lane
+#define MAX_LANES 16
+// Windows of the chunk probed
+#define NWINDOWS 8
+#define WINDOW (8 * 1024)
+
+typedef struct {
+  uint32_t hist[MAX_LANES][256];
+  // Histogram of every byte lane
+  uint32_t flips[MAX_LANES][8];
+  // Changes of every bit plane from one element to the next
+  uint64_t nbytes;
+  uint64_t runs;
+  uint64_t lane_runs;
+} lane_stats;
+
+
+// Gather the stats of a window, which starts at the first byte of an element
+static void scan_window(const uint8_t *src, int32_t size, int32_t typesize, int nlanes,
+                        lane_stats *stats) {
+  int lane = 0;
+  for (int32_t i = 0; i < size; i++) {
+    uint8_t byte = src[i];
+    stats->hist[lane][byte]++;
+    if (i > 0 && byte == src[i - 1]) {
+      stats->runs++;
+    }
+    if (i >= typesize) {
+      uint8_t changes = byte ^ src[i - typesize];
+      if (changes == 0) {
+        stats->lane_runs++;
+      }
+      for (int bit = 0; changes != 0; bit++, changes >>= 1) {
+        stats->flips[lane][bit] += changes & 1;
+      }
+    }
+    if (++lane == nlanes) {
+      lane = 0;
+    }
+  }
+  stats->nbytes += size;
+}
+
+static double entropy(const uint32_t *hist, uint64_t total) {
+  double h = 0;
+  for (int i = 0; i < 256; i++) {
+    if (hist[i] > 0) {
+      double p = (double) hist[i] / (double) total;
+      h -= p * log2(p);
+    }
+  }
+  return h;
+}
+
+static double binary_entropy(double p) {
+  if (p <= 0 || p >= 1) {
+    return 0;
+  }
+  return -p * log2(p) - (1 - p) * log2(1 - p);
+}
+
+void entropy_filters_probe(const uint8_t *src, int32_t size, int32_t typesize,
+                           entropy_filters_features *features) {
+  memset(features, 0, sizeof(entropy_filters_features));
+  if (typesize <= 0 || size < typesize) {
+    return;
+  }
+  int nlanes = (typesize <= MAX_LANES) ? typesize : 1;
+  // Windows hold whole elements
+  int32_t window = (WINDOW / typesize) * typesize;
+  if (window == 0) {
+    window = typesize;
+  }
+
+  lane_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  if (size <= NWINDOWS * window) {
+    scan_window(src, size - size % typesize, typesize, nlanes, &stats);
+  }
+  else {
+    int64_t nelems = size / typesize;
+    int64_t window_elems = window / typesize;
+    for (int i = 0; i < NWINDOWS; i++) {
+      int64_t start = ((2 * (int64_t) i + 1) * (nelems - window_elems)) / (2 * NWINDOWS);
+      scan_window(src + start * typesize, window, typesize, nlanes, &stats);
+    }
+  }
+  if (stats.nbytes == 0) {
+    return;
+  }
+
+  uint32_t total_hist[256] = {0};
+  double lane_entropy = 0;
+  double bitplane_entropy = 0;
+  uint64_t lane_bytes = stats.nbytes / nlanes;
+  for (int lane = 0; lane < nlanes; lane++) {
+    lane_entropy += entropy(stats.hist[lane], lane_bytes);
+    // The bit planes follow from the byte histograms
+    uint64_t ones[8] = {0};
+    for (int value = 0; value < 256; value++) {
+      uint32_t count = stats.hist[lane][value];
+      total_hist[value] += count;
+      for (int bit = 0; bit < 8; bit++) {
+        if (value & (1 << bit)) {
+          ones[bit] += count;
+        }
+      }
+    }
+    // A plane is as cheap as its bit balance or its changes (i.e. its runs) make it
+    for (int bit = 0; bit < 8; bit++) {
+      double balance = binary_entropy((double) ones[bit] / (double) lane_bytes);
+      double changes = binary_entropy((double) stats.flips[lane][bit] / (double) lane_bytes);
+      bitplane_entropy += (balance < changes) ? balance : changes;
+    }
+  }
+
+  features->entropy = (float) entropy(total_hist, stats.nbytes);
+  features->runs = (float) ((double) stats.runs / (double) stats.nbytes);
+  features->lane_entropy = (float) (lane_entropy / nlanes);
+  features->lane_runs = (float) ((double) stats.lane_runs / (double) stats.nbytes);
+  // The entropies of the 8 planes of a lane add up to bits per byte
+  features->bitplane_entropy = (float) (bitplane_entropy / nlanes);
+}
+
+float entropy_filters_estimate(const entropy_filters_features *features, uint8_t filter) {
+  switch (filter) {
+    case BLOSC_NOFILTER:
+      return features->entropy * (1 - features->runs);
+    case BLOSC_SHUFFLE:
+      // Repeated lane bytes become runs once shuffled
+      return features->lane_entropy * (1 - features->lane_runs);
+    case BLOSC_BITSHUFFLE:
+      return features->bitplane_entropy;
+    default:
+      return -1;
+  }
+}
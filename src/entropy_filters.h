@@ -0,0 +1,56 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  entropy_filters.h
+ * @brief Entropy of a chunk as seen after the shuffle filters.
+ *
+ * A single pass over a few windows of the chunk gathers the histograms of its
+ * byte lanes (byte i of every element, which shuffle puts together), from which
+ * the entropies of the lanes and of the bit planes (which bitshuffle puts
+ * together) follow, without materializing any filtered buffer.
+ */
+
+#ifndef ENTROPY_FILTERS_H
+#define ENTROPY_FILTERS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  float entropy;
+  // Order-0 entropy of the bytes, in bits per byte
+  float runs;
+  // Fraction of the bytes equal to the previous one
+  float lane_entropy;
+  // Mean order-0 entropy of the byte lanes, in bits per byte
+  float lane_runs;
+  // Fraction of the bytes equal to the same byte of the previous element
+  float bitplane_entropy;
+  // Mean entropy of the bit planes (from their balance or their runs), in bits per byte
+} entropy_filters_features;
+
+// Compute the features of `src` for elements of `typesize` bytes
+void entropy_filters_probe(const uint8_t *src, int32_t size, int32_t typesize,
+                           entropy_filters_features *features);
+
+// Rough estimate of the bits per byte left after `filter` (a BLOSC_NOFILTER,
+// BLOSC_SHUFFLE or BLOSC_BITSHUFFLE) and a fast codec.  Lower is better, and a
+// negative value means that there is no estimate for the filter.
+float entropy_filters_estimate(const entropy_filters_features *features, uint8_t filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ENTROPY_FILTERS_H */
@@ -15,186 +15,182 @@
 
 #include <blosc2.h>
 #include "entropy_probe.h"
+#include "entropy_probe_match.h"
 
 
-#define MAX_COPY 32U
-#define MAX_DISTANCE 8191
-#define MAX_FARDISTANCE (65535 + MAX_DISTANCE - 1)
+typedef float (*get_cratio_fn)(const uint8_t *ibase, int maxlen, int minlen, int ipshift);
 
-// The hash length (1 << HASH_LOG) can be tuned for performance (12 -> 15)
-#define HASH_LOG (13U)
-
-#define HASH_FUNCTION(v, s, h)              \
-    {                                       \
-        v = (s * 2654435761U) >> (32U - h); \
-    }
-
-#define BLOSCLZ_READU16(p) *((const uint16_t *)(p))
-#define BLOSCLZ_READU32(p) *((const uint32_t *)(p))
-
-#define LITERAL2(ip, anchor, copy) \
-    {                              \
-        oc++;                      \
-        anchor++;                  \
-        ip = anchor;               \
-        copy++;                    \
-        if (copy == MAX_COPY) {    \
-            copy = 0;              \
-            oc++;                  \
-        }                          \
-    }
+float entropy_probe_get_cratio_generic(const uint8_t *ibase, int maxlen, int minlen, int ipshift) {
+  return probe_get_cratio(ibase, maxlen, minlen, ipshift);
+}
 
-static uint8_t *get_run(uint8_t *ip, const uint8_t *ip_bound, const uint8_t *ref) {
-  uint8_t x = ip[-1];
-  int64_t value, value2;
-  /* Broadcast the value for every byte in a 64-bit register */
-  memset(&value, x, 8);
-  /* safe because the outer check against ip limit */
-  while (ip < (ip_bound - sizeof(int64_t))) {
-    value2 = ((int64_t *) ref)[0];
-    if (value != value2) {
-      /* Return the byte that starts to differ */
-      while (*ref++ == x)
-        ip++;
-      return ip;
-    } else {
-      ip += 8;
-      ref += 8;
-    }
+#if defined(ENTROPY_PROBE_AVX2)
+bool entropy_probe_has_avx2(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int regs[4];
+  __cpuid(regs, 1);
+  // AVX, and the OS saving the YMM registers
+  if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+    return false;
   }
-  /* Look into the remainder */
-  while ((ip < ip_bound) && (*ref++ == x))
-    ip++;
-  return ip;
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+bool entropy_probe_has_avx2(void) {
+  return false;
 }
+#endif
 
-static uint8_t *get_match(uint8_t *ip, const uint8_t *ip_bound, const uint8_t *ref) {
-  while (ip < (ip_bound - sizeof(int64_t))) {
-    if (*(int64_t *) ref != *(int64_t *) ip) {
-      /* Return the byte that starts to differ */
-      while (*ref++ == *ip++) {
-      }
-      return ip;
-    } else {
-      ip += sizeof(int64_t);
-      ref += sizeof(int64_t);
-    }
+static get_cratio_fn select_get_cratio(void) {
+#if defined(ENTROPY_PROBE_AVX2)
+  if (entropy_probe_has_avx2()) {
+    return entropy_probe_get_cratio_avx2;
   }
-  /* Look into the remainder */
-  while ((ip < ip_bound) && (*ref++ == *ip++)) {
-  }
-  return ip;
+#endif
+  return entropy_probe_get_cratio_generic;
 }
 
-static uint8_t *get_run_or_match(uint8_t *ip, uint8_t *ip_bound, const uint8_t *ref, bool run) {
-  if (run) {
-    ip = get_run(ip, ip_bound, ref);
-  } else {
-    ip = get_match(ip, ip_bound, ref);
+// Get a guess for the compressed size of a buffer, with the best variant for the CPU
+static float get_cratio(const uint8_t *ibase, int maxlen, int minlen, int ipshift) {
+  // Every thread selects the same variant, so racing here is harmless
+  static get_cratio_fn impl = NULL;
+  if (impl == NULL) {
+    impl = select_get_cratio();
   }
-
-  return ip;
+  return impl(ibase, maxlen, minlen, ipshift);
 }
 
-// Get a guess for the compressed size of a buffer
-static float get_cratio(const uint8_t *ibase, int maxlen, int minlen, int ipshift) {
-  const uint8_t *ip = ibase;
-  int32_t oc = 0;
-  const uint16_t hashlen = (1U << (uint8_t)HASH_LOG);
-  uint32_t htab[1U << (uint8_t)HASH_LOG];
-  uint32_t hval;
-  uint32_t seq;
-  uint8_t copy;
-  // Make a tradeoff between testing too much and too little
-  uint16_t limit = (maxlen > hashlen) ? hashlen : maxlen;
-  const uint8_t *ip_bound = ibase + limit - 1;
-  const uint8_t *ip_limit = ibase + limit - 12;
-
-  // Initialize the hash table to distances of 0
-  memset(htab, 0, hashlen * sizeof(uint32_t));
-
-  /* we start with literal copy */
-  copy = 4;
-  oc += 5;
-
-  /* main loop */
-  while (ip < ip_limit) {
-    const uint8_t *ref;
-    unsigned distance;
-    const uint8_t *anchor = ip; /* comparison starting-point */
-
-    /* find potential match */
-    seq = BLOSCLZ_READU32(ip);
-    HASH_FUNCTION(hval, seq, HASH_LOG)
-    ref = ibase + htab[hval];
-
-    /* calculate distance to the match */
-    distance = (unsigned int) (anchor - ref);
-
-    /* update hash table */
-    htab[hval] = (uint32_t)(anchor - ibase);
-
-    if (distance == 0 || (distance >= MAX_FARDISTANCE)) {
-      LITERAL2(ip, anchor, copy)
-      continue;
-    }
+// Number of windows probed by entropy_probe_cratio
+#define PROBE_NWINDOWS 4
 
-    /* is this a match? check the first 4 bytes */
-    if (BLOSCLZ_READU32(ref) == BLOSCLZ_READU32(ip)) {
-      ref += 4;
-    } else {
-      /* no luck, copy as a literal */
-      LITERAL2(ip, anchor, copy)
-      continue;
-    }
+float entropy_probe_cratio(const uint8_t *src, int32_t size) {
+  // get_cratio only looks at the first (1 << HASH_LOG) bytes of every window
+  int32_t window = 1 << HASH_LOG;
+  if (size < 32) {
+    return 1.f;
+  }
+  if (size <= PROBE_NWINDOWS * window) {
+    return get_cratio(src, size, 3, 3);
+  }
+  float cratio = 0;
+  for (int i = 0; i < PROBE_NWINDOWS; i++) {
+    int64_t start = ((2 * (int64_t) i + 1) * (size - window)) / (2 * PROBE_NWINDOWS);
+    cratio += get_cratio(src + start, window, 3, 3);
+  }
+  return cratio / PROBE_NWINDOWS;
+}
 
-    /* last matched byte */
-    ip = anchor + 4;
+// Windows sampled across a block: get_cratio() does not look further than the max
+#define SAMPLE_WINDOW_MAX (1 << HASH_LOG)
+#define SAMPLE_WINDOW_MIN 1024
+#define SAMPLE_MIN_NWINDOWS 4
+
+typedef struct {
+  const uint8_t *src;
+  int32_t size;
+  int32_t blocksize;
+  int32_t budget;
+  entropy_probe_block *blocks;
+} probe_task;
+
+// Estimate the cratio of a block with `budget` bytes sampled in windows spread
+// across it, and the variance between the windows.  Returns the bytes probed.
+static int32_t sample_cratio(const uint8_t *block, int32_t bsize, int32_t budget,
+                             float *cratio, float *variance) {
+  int32_t window = SAMPLE_WINDOW_MAX;
+  if (budget < SAMPLE_MIN_NWINDOWS * window) {
+    window = budget / SAMPLE_MIN_NWINDOWS;
+    if (window < SAMPLE_WINDOW_MIN) {
+      window = SAMPLE_WINDOW_MIN;
+    }
+  }
+  int nwindows = budget / window;
+  if (nwindows > bsize / window) {
+    nwindows = bsize / window;
+  }
+  if (nwindows < 2) {
+    // Not enough room for sampling, probe the head as usual
+    *cratio = get_cratio(block, bsize, 3, 3);
+    *variance = 0.f;
+    return (bsize < SAMPLE_WINDOW_MAX) ? bsize : SAMPLE_WINDOW_MAX;
+  }
 
-    /* distance is biased */
-    distance--;
+  // Welford's algorithm
+  double mean = 0, m2 = 0;
+  for (int i = 0; i < nwindows; i++) {
+    int64_t start = ((2 * (int64_t) i + 1) * (bsize - window)) / (2 * nwindows);
+    double value = get_cratio(block + start, window, 3, 3);
+    double delta = value - mean;
+    mean += delta / (i + 1);
+    m2 += delta * (value - mean);
+  }
+  *cratio = (float) mean;
+  *variance = (float) (m2 / nwindows);
+  return nwindows * window;
+}
 
-    /* get runs or matches; zero distance means a run */
-    ip = get_run_or_match((uint8_t *) ip, (uint8_t *) ip_bound, ref, !distance);
+static bool is_run(const uint8_t *src, int32_t size) {
+  return size > 0 && (size == 1 || (src[0] == src[size - 1] && memcmp(src, src + 1, size - 1) == 0));
+}
 
-    ip -= ipshift;
-    int32_t len = (int32_t)(ip - anchor);
-    if (len < minlen) {
-      LITERAL2(ip, anchor, copy)
-      continue;
-    }
+static void probe_block(void *arg, int index, int worker) {
+  (void) worker;
+  probe_task *task = (probe_task *) arg;
+  int64_t start = (int64_t) index * task->blocksize;
+  int32_t bsize = (int32_t) ((task->size - start < task->blocksize) ? task->size - start : task->blocksize);
+  const uint8_t *block = task->src + start;
+  entropy_probe_block *features = &task->blocks[index];
+
+  // Too small blocks are left to a memcpy by blosc2, do not count them either
+  if (bsize < 32 || is_run(block, bsize)) {
+    features->cratio = 1.f;
+    features->cratio_var = 0.f;
+    features->cspeed = 0.f;
+    features->special = true;
+    return;
+  }
+  blosc_timestamp_t t0, t1;
+  blosc_set_timestamp(&t0);
+  // Same minlen and ipshift as the codec below
+  int32_t probed = (bsize < SAMPLE_WINDOW_MAX) ? bsize : SAMPLE_WINDOW_MAX;
+  if (task->budget > 0) {
+    probed = sample_cratio(block, bsize, task->budget, &features->cratio, &features->cratio_var);
+  }
+  else {
+    features->cratio = get_cratio(block, bsize, 3, 3);
+    features->cratio_var = 0.f;
+  }
+  blosc_set_timestamp(&t1);
+  double elapsed = blosc_elapsed_secs(t0, t1);
+  // Scale the time to the bytes probed without sampling, so that the speeds do not
+  // depend on the budget.  And avoid infinite speeds with coarse clocks.
+  int32_t head = (bsize < SAMPLE_WINDOW_MAX) ? bsize : SAMPLE_WINDOW_MAX;
+  elapsed *= (double) head / probed;
+  features->cspeed = (float) (bsize / ((elapsed > 1e-9) ? elapsed : 1e-9));
+  features->special = false;
+}
 
-    /* if we haven't copied anything, adjust the output counter */
-    if (!copy)
-      oc--;
-    /* reset literal counter */
-    copy = 0;
-
-    /* encode the match */
-    if (distance < MAX_DISTANCE) {
-      if (len >= 7) {
-        oc += ((len - 7) / 255) + 1;
-      }
-      oc += 2;
-    } else {
-      /* far away, but not yet in the another galaxy... */
-      if (len >= 7) {
-        oc += ((len - 7) / 255) + 1;
-      }
-      oc += 4;
+int entropy_probe_blocks(const uint8_t *src, int32_t size, int32_t blocksize, int32_t budget,
+                         btune_pool *pool, entropy_probe_block *blocks) {
+  if (size <= 0 || blocksize <= 0) {
+    return 0;
+  }
+  int nblocks = (int) (((int64_t) size + blocksize - 1) / blocksize);
+  probe_task task = {src, size, blocksize, budget, blocks};
+  if (pool != NULL) {
+    btune_pool_run(pool, probe_block, &task, nblocks);
+  }
+  else {
+    for (int i = 0; i < nblocks; i++) {
+      probe_block(&task, i, 0);
     }
-
-    /* update the hash at match boundary */
-    seq = BLOSCLZ_READU32(ip);
-    HASH_FUNCTION(hval, seq, HASH_LOG)
-    htab[hval] = (uint32_t)(ip++ - ibase);
-    ip++;
-    /* assuming literal copy */
-    oc++;
   }
-
-  float ic = (float) (ip - ibase);
-  return ic / (float) oc;
+  return nblocks;
 }
 
 static int encoder(const uint8_t *input, int32_t input_len,
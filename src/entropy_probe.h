@@ -16,12 +16,36 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <blosc2.h>
+#include "btune_pool.h"
 
 #define ENTROPY_PROBE_ID 244
+
+// Features of a block, as estimated by the entropy probe
+typedef struct {
+  float cratio;
+  // Estimated compression ratio (the mean of the windows when sampling)
+  float cratio_var;
+  // Variance of the cratio between the sampled windows (0 for a single window)
+  float cspeed;
+  // Speed of the probe over the block, in bytes/s
+  bool special;
+  // Whether the block is a run of a single byte (the estimates are meaningless then)
+} entropy_probe_block;
+
 void register_entropy_codec(blosc2_codec *codec);
 #define FILTER_STOP 3
 float get_zeros_speed(int32_t chunksize);
+// Cheap cratio estimate of a buffer, probing a few windows spread over it
+float entropy_probe_cratio(const uint8_t *src, int32_t size);
+// Probe every block of `src` directly (no blosc2 round trip), spreading the
+// blocks over `pool` (sequentially if NULL).  With a positive `budget`, that
+// many bytes are sampled in windows across every block, else only its head is
+// probed.  The features are written to `blocks`, which must have room for all
+// of them.  Returns the number of blocks.
+int entropy_probe_blocks(const uint8_t *src, int32_t size, int32_t blocksize, int32_t budget,
+                         btune_pool *pool, entropy_probe_block *blocks);
 #ifdef __cplusplus
 }
 #endif
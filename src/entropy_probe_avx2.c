@@ -0,0 +1,23 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+// This file is compiled with AVX2 enabled (see CMakeLists.txt), and only used
+// when the CPU supports it (see entropy_probe_has_avx2()).
+
+#include "entropy_probe_match.h"
+
+#if defined(__AVX2__)
+
+float entropy_probe_get_cratio_avx2(const uint8_t *ibase, int maxlen, int minlen, int ipshift) {
+  return probe_get_cratio(ibase, maxlen, minlen, ipshift);
+}
+
+#endif  /* __AVX2__ */
@@ -0,0 +1,290 @@
+/*********************************************************************
+  Btune for Blosc2 - Automatically choose the best codec/filter for your data
+
+  Copyright (c) 2023-present  Blosc Development Team <blosc@blosc.org>
+  https://btune.blosc.org
+  Copyright (c) 2023-present  ironArray SLU <contact@ironarray.io>
+  https://ironarray.io
+  License: GNU Affero General Public License v3.0
+  See LICENSE.txt for details about copyright and rights to use.
+**********************************************************************/
+
+/** @file  entropy_probe_match.h
+ * @brief Match finder of the entropy probe.
+ *
+ * The BloscLZ-style estimator behind the entropy probe is written once here
+ * and compiled twice: in entropy_probe.c for any CPU, and in
+ * entropy_probe_avx2.c with AVX2 enabled, where the only difference is that
+ * runs longer than 8 bytes are extended with 256-bit compares.  Matches are
+ * mostly short, and going wide for them made the probe slower on data without
+ * long runs, so they use the 64-bit path in both.  The CPU is checked at
+ * runtime for choosing the variant, and both give exactly the same estimates.
+ */
+
+#ifndef ENTROPY_PROBE_MATCH_H
+#define ENTROPY_PROBE_MATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+  #include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Variants of the estimator: see get_cratio() below
+float entropy_probe_get_cratio_generic(const uint8_t *ibase, int maxlen, int minlen, int ipshift);
+float entropy_probe_get_cratio_avx2(const uint8_t *ibase, int maxlen, int minlen, int ipshift);
+// Whether the AVX2 variant has been built and the CPU supports it
+bool entropy_probe_has_avx2(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#define MAX_COPY 32U
+#define MAX_DISTANCE 8191
+#define MAX_FARDISTANCE (65535 + MAX_DISTANCE - 1)
+
+// The hash length (1 << HASH_LOG) can be tuned for performance (12 -> 15)
+#define HASH_LOG (13U)
+#define HASH_MULTIPLIER 2654435761U
+
+#define HASH_FUNCTION(v, s, h)              \
+    {                                       \
+        v = (s * HASH_MULTIPLIER) >> (32U - h); \
+    }
+
+#define BLOSCLZ_READU16(p) *((const uint16_t *)(p))
+#define BLOSCLZ_READU32(p) *((const uint32_t *)(p))
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WIN32)
+  #define PROBE_LITTLE_ENDIAN
+#endif
+
+#define LITERAL2(ip, anchor, copy) \
+    {                              \
+        oc++;                      \
+        anchor++;                  \
+        ip = anchor;               \
+        copy++;                    \
+        if (copy == MAX_COPY) {    \
+            copy = 0;              \
+            oc++;                  \
+        }                          \
+    }
+
+#if defined(PROBE_LITTLE_ENDIAN) && (defined(__GNUC__) || defined(__clang__) || defined(_M_X64) || defined(_M_ARM64))
+  #define PROBE_HAVE_CTZ
+#endif
+
+#if defined(PROBE_HAVE_CTZ)
+// Index of the first byte that differs in two different 64-bit words
+static inline int probe_first_diff(uint64_t a, uint64_t b) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward64(&index, a ^ b);
+  return (int) index / 8;
+#else
+  return __builtin_ctzll(a ^ b) / 8;
+#endif
+}
+#endif
+
+#if defined(__AVX2__)
+// Index of the first byte that differs in two 32-byte vectors (32 if none)
+static inline int probe_first_diff256(__m256i a, __m256i b) {
+  uint32_t diff = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+  if (diff == 0) {
+    return 32;
+  }
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, diff);
+  return (int) index;
+#else
+  return __builtin_ctz(diff);
+#endif
+}
+#endif
+
+static inline uint8_t *probe_get_run(uint8_t *ip, const uint8_t *ip_bound, const uint8_t *ref) {
+  uint8_t x = ip[-1];
+  int64_t value, value2;
+  /* Broadcast the value for every byte in a 64-bit register */
+  memset(&value, x, 8);
+#if defined(__AVX2__)
+  /* Most runs are short, so only go wide after a first 64-bit word */
+  if (ip < (ip_bound - sizeof(int64_t)) && value == ((int64_t *) ref)[0]) {
+    ip += 8;
+    ref += 8;
+    __m256i value256 = _mm256_set1_epi8((char) x);
+    while (ip_bound - ip > (int) sizeof(__m256i)) {
+      int n = probe_first_diff256(value256, _mm256_loadu_si256((const __m256i *) ref));
+      if (n < 32) {
+        return ip + n;
+      }
+      ip += sizeof(__m256i);
+      ref += sizeof(__m256i);
+    }
+  }
+#endif
+  /* safe because the outer check against ip limit */
+  while (ip < (ip_bound - sizeof(int64_t))) {
+    value2 = ((int64_t *) ref)[0];
+    if (value != value2) {
+      /* Return the byte that starts to differ */
+#if defined(PROBE_HAVE_CTZ)
+      return ip + probe_first_diff((uint64_t) value, (uint64_t) value2);
+#else
+      while (*ref++ == x)
+        ip++;
+      return ip;
+#endif
+    } else {
+      ip += 8;
+      ref += 8;
+    }
+  }
+  /* Look into the remainder */
+  while ((ip < ip_bound) && (*ref++ == x))
+    ip++;
+  return ip;
+}
+
+static inline uint8_t *probe_get_match(uint8_t *ip, const uint8_t *ip_bound, const uint8_t *ref) {
+  while (ip < (ip_bound - sizeof(int64_t))) {
+    if (*(int64_t *) ref != *(int64_t *) ip) {
+      /* Return the byte after the first one that differs */
+#if defined(PROBE_HAVE_CTZ)
+      return ip + probe_first_diff(*(uint64_t *) ref, *(uint64_t *) ip) + 1;
+#else
+      while (*ref++ == *ip++) {
+      }
+      return ip;
+#endif
+    } else {
+      ip += sizeof(int64_t);
+      ref += sizeof(int64_t);
+    }
+  }
+  /* Look into the remainder */
+  while ((ip < ip_bound) && (*ref++ == *ip++)) {
+  }
+  return ip;
+}
+
+// Get a guess for the compressed size of a buffer
+static inline float probe_get_cratio(const uint8_t *ibase, int maxlen, int minlen, int ipshift) {
+  const uint8_t *ip = ibase;
+  int32_t oc = 0;
+  const uint16_t hashlen = (1U << (uint8_t)HASH_LOG);
+  uint32_t htab[1U << (uint8_t)HASH_LOG];
+  uint32_t hval;
+  uint32_t seq;
+  uint8_t copy;
+  // Make a tradeoff between testing too much and too little
+  uint16_t limit = (maxlen > hashlen) ? hashlen : maxlen;
+  const uint8_t *ip_bound = ibase + limit - 1;
+  const uint8_t *ip_limit = ibase + limit - 12;
+
+  // Initialize the hash table to distances of 0
+  memset(htab, 0, hashlen * sizeof(uint32_t));
+
+  /* we start with literal copy */
+  copy = 4;
+  oc += 5;
+
+  /* main loop */
+  while (ip < ip_limit) {
+    const uint8_t *ref;
+    unsigned distance;
+    const uint8_t *anchor = ip; /* comparison starting-point */
+
+    /* find potential match */
+    seq = BLOSCLZ_READU32(ip);
+    HASH_FUNCTION(hval, seq, HASH_LOG)
+    ref = ibase + htab[hval];
+
+    /* calculate distance to the match */
+    distance = (unsigned int) (anchor - ref);
+
+    /* update hash table */
+    htab[hval] = (uint32_t)(anchor - ibase);
+
+    if (distance == 0 || (distance >= MAX_FARDISTANCE)) {
+      LITERAL2(ip, anchor, copy)
+      continue;
+    }
+
+    /* is this a match? check the first 4 bytes */
+    if (BLOSCLZ_READU32(ref) == BLOSCLZ_READU32(ip)) {
+      ref += 4;
+    } else {
+      /* no luck, copy as a literal */
+      LITERAL2(ip, anchor, copy)
+      continue;
+    }
+
+    /* last matched byte */
+    ip = anchor + 4;
+
+    /* distance is biased */
+    distance--;
+
+    /* get runs or matches; zero distance means a run */
+    if (!distance) {
+      ip = probe_get_run((uint8_t *) ip, ip_bound, ref);
+    } else {
+      ip = probe_get_match((uint8_t *) ip, ip_bound, ref);
+    }
+
+    ip -= ipshift;
+    int32_t len = (int32_t)(ip - anchor);
+    if (len < minlen) {
+      LITERAL2(ip, anchor, copy)
+      continue;
+    }
+
+    /* if we haven't copied anything, adjust the output counter */
+    if (!copy)
+      oc--;
+    /* reset literal counter */
+    copy = 0;
+
+    /* encode the match */
+    if (distance < MAX_DISTANCE) {
+      if (len >= 7) {
+        oc += ((len - 7) / 255) + 1;
+      }
+      oc += 2;
+    } else {
+      /* far away, but not yet in the another galaxy... */
+      if (len >= 7) {
+        oc += ((len - 7) / 255) + 1;
+      }
+      oc += 4;
+    }
+
+    /* update the hash at match boundary */
+    seq = BLOSCLZ_READU32(ip);
+    HASH_FUNCTION(hval, seq, HASH_LOG)
+    htab[hval] = (uint32_t)(ip++ - ibase);
+    ip++;
+    /* assuming literal copy */
+    oc++;
+  }
+
+  float ic = (float) (ip - ibase);
+  return ic / (float) oc;
+}
+
+#endif  /* ENTROPY_PROBE_MATCH_H */
@@ -47,6 +47,21 @@
 #define pthread_mutex_lock EnterCriticalSection
 #define pthread_mutex_unlock LeaveCriticalSection
 
+/*
+ * One-time initialization, on top of the Windows one
+ */
+#define pthread_once_t INIT_ONCE
+#define PTHREAD_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+static __inline BOOL CALLBACK win32_pthread_once_routine(PINIT_ONCE once, PVOID routine,
+                                                         PVOID *context) {
+	((void (*)(void)) routine)();
+	return TRUE;
+}
+
+#define pthread_once(once, routine) \
+	(InitOnceExecuteOnce((once), win32_pthread_once_routine, (PVOID) (routine), NULL) ? 0 : -1)
+
 /*
  * Implement simple condition variable for Windows threads, based on ACE
  * implementation.